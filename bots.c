@@ -0,0 +1,195 @@
+/**
+ * bots
+ *
+ * Steering without a player, for races without a terminal.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bots.h"
+#include "solve.h"
+
+/**
+ * One column towards a position.
+ */
+static int
+towards(int xpos, int target)
+{
+	return (target > xpos) - (target < xpos);
+}
+
+/**
+ * Never steers.
+ */
+static int
+steer_straight(void* state, const struct sim* sim)
+{
+	return 0;
+}
+
+/**
+ * Steers towards the middle of the row drawn last, like a careful player.
+ */
+static int
+steer_center(void* state, const struct sim* sim)
+{
+	/* nothing drawn before the first row */
+	if (sim->row == 0) {
+		return 0;
+	}
+	return towards(sim->xpos, (sim->leftmargin + sim->rightmargin) / 2);
+}
+
+/**
+ * Steers towards the middle of the row to come.
+ */
+static int
+steer_lookahead(void* state, const struct sim* sim)
+{
+	struct track_cursor ahead = sim->cursor;
+	unsigned int left;
+	unsigned int right;
+
+	if (!track_next(&ahead, &left, &right)) {
+		return 0;
+	}
+	return towards(sim->xpos, (left + right) / 2);
+}
+
+/**
+ * The seed of the random bot, a state of its own per race.
+ */
+static void*
+start_random(const struct track* track, unsigned long seed)
+{
+	unsigned long* state = malloc(sizeof(*state));
+
+	if (state != NULL) {
+		/* xorshift never leaves 0 */
+		*state = seed ? seed : 1;
+	}
+	return state;
+}
+
+/**
+ * Presses keys at random, a baseline for the others.
+ */
+static int
+steer_random(void* state, const struct sim* sim)
+{
+	unsigned long* x = state;
+
+	if (x == NULL) {
+		return 0;
+	}
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return (int)(*x % 3) - 1;
+}
+
+/**
+ * Solves the track before the race.
+ */
+static void*
+start_autopilot(const struct track* track, unsigned long seed)
+{
+	struct solve* solve = malloc(sizeof(*solve));
+
+	if ((solve != NULL) && (solve_init(solve, track) < 0)) {
+		free(solve);
+		solve = NULL;
+	}
+	return solve;
+}
+
+/**
+ * Follows the plan of the solver, a way through whenever there is one.
+ */
+static int
+steer_autopilot(void* state, const struct sim* sim)
+{
+	if (state == NULL) {
+		return 0;
+	}
+	return solve_next(state);
+}
+
+/**
+ * Releases the plan.
+ */
+static void
+finish_autopilot(void* state)
+{
+	if (state != NULL) {
+		solve_free(state);
+		free(state);
+	}
+}
+
+const struct bot bots[] = {
+	{ "straight",  "never steers",                             NULL,         steer_straight,  NULL },
+	{ "center",    "towards the middle of the last row",       NULL,         steer_center,    NULL },
+	{ "lookahead", "towards the middle of the next row",       NULL,         steer_lookahead, NULL },
+	{ "random",    "random keys",                              start_random, steer_random,    free },
+	{ "autopilot", "the fewest keys that win, if any do",      start_autopilot, steer_autopilot, finish_autopilot },
+};
+
+const unsigned int bot_count = sizeof(bots) / sizeof(bots[0]);
+
+const struct bot*
+bot_find(const char* name)
+{
+	unsigned int i;
+
+	for (i = 0; i < bot_count; i++) {
+		if (!strcmp(bots[i].name, name)) {
+			return &bots[i];
+		}
+	}
+	return NULL;
+}
+
+int
+bot_race(const struct bot* bot, const struct track* track, unsigned long seed,
+		unsigned int limit, struct sim* sim)
+{
+	void* state = NULL;
+	int dx;
+
+	if (bot->start != NULL) {
+		state = bot->start(track, seed);
+	}
+
+	sim_init(sim, track);
+	while ((sim->state == SIM_RUNNING) && ((limit == 0) || (sim->row < limit))) {
+		/* one column per row at most, like term_racer */
+		dx = bot->steer(state, sim);
+		sim_step(sim, (dx > 0) - (dx < 0));
+	}
+
+	if (bot->finish != NULL) {
+		bot->finish(state);
+	}
+	return sim->state;
+}
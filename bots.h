@@ -0,0 +1,89 @@
+/**
+ * bots
+ *
+ * Steering without a player, for races without a terminal.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef BOTS_H
+#define BOTS_H
+
+#include "track.h"
+#include "sim.h"
+
+/**
+ * A bot and what it remembers during a race.
+ *
+ * Before every row the bot sees the race as a player would: the
+ * position and the row drawn last. A bot may copy the cursor and peek
+ * at the rows ahead, a player can not.
+ */
+struct bot {
+	const char* name;
+	const char* description;
+
+	/**
+	 * Prepares a race, may be NULL.
+	 *
+	 * @param seed The same seed gives the same race.
+	 *
+	 * @return what the bot remembers, NULL for nothing.
+	 */
+	void* (*start)(const struct track* track, unsigned long seed);
+
+	/**
+	 * The steering for the next row.
+	 *
+	 * @return -1 left, 0 straight, 1 right.
+	 */
+	int (*steer)(void* state, const struct sim* sim);
+
+	/**
+	 * Releases what start returned, may be NULL.
+	 */
+	void (*finish)(void* state);
+};
+
+/* every bot there is */
+extern const struct bot bots[];
+extern const unsigned int bot_count;
+
+/**
+ * Finds a bot by its name.
+ *
+ * @return the bot, NULL if there is none of that name.
+ */
+const struct bot*
+bot_find(const char* name);
+
+/**
+ * Runs a whole race with a bot steering.
+ *
+ * @param sim Set to the race at its end.
+ * @param limit Rows to race at most, 0 for no limit.
+ *
+ * @return the state at the end, SIM_RUNNING if the limit was reached.
+ */
+int
+bot_race(const struct bot* bot, const struct track* track, unsigned long seed,
+		unsigned int limit, struct sim* sim);
+
+#endif
@@ -0,0 +1,383 @@
+/**
+ * frame_bench
+ *
+ * Drives the racers through a pseudo terminal with scripted input and
+ * measures when their rows show up, to compare the timing of the loops.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <pty.h>
+#include <sys/wait.h>
+
+#define BUFFLEN 4096
+
+/* width of the benchmark track */
+#define TRACK_SIZE 40
+
+/* the racers sleep that long before the first row */
+#define START_DELAY_MS 3000
+
+/* rows at the end without keys, all of them are through by the goal */
+#define KEY_STOP_ROWS 5
+
+/* what a racer that counts its keys prints at the end */
+#define KEYS_FORMAT "Keys: %lu read, %lu applied, %lu dropped with the ring full, "\
+		"%lu left, %ld lost, %lu out of order"
+
+/**
+ * A racer to measure and the frame period it aims for.
+ */
+struct variant {
+	const char* name;
+	/* FRAME_TARGET_MS / TIMEOUT of the racer, in ms */
+	double period;
+};
+
+static const struct variant variants[] = {
+	{ "term_racer",        120.0 },
+	{ "term_racer_simple", 120.0 },
+	{ "thread_racer",      100.0 },
+};
+
+#define VARIANTS (sizeof(variants) / sizeof(variants[0]))
+
+/**
+ * Prints how to call the benchmark.
+ */
+void
+usage(const char* name);
+
+/**
+ * Writes a straight track, nobody crashes while steering 'j' and 'k'
+ * in turns.
+ *
+ * @return the file name, unlink and free it when done.
+ */
+char*
+write_map(unsigned int rows);
+
+/**
+ * Runs one racer and prints its timing. A racer that counts its keys
+ * has to have read every key sent and applied or dropped each one of
+ * them, in order.
+ *
+ * @return 0 on success, -1 if it could not be measured or lost keys.
+ */
+int
+bench(const struct variant* variant, const char* map, unsigned int rows, double interval);
+
+/**
+ * Milliseconds on the monotonic clock.
+ */
+double
+now_ms(void);
+
+/**
+ * Sorting doubles with qsort.
+ */
+int
+compare_double(const void* a, const void* b);
+
+int main(int argc, char** argv)
+{
+	unsigned int rows = 50;
+	double interval = 40.0;
+	char* map;
+	unsigned int i;
+	int j;
+	int c;
+	int result = 0;
+	int found;
+
+	while ((c = getopt(argc, argv, "r:i:")) != -1) {
+		switch (c) {
+			case 'r':
+				rows = strtoul(optarg, NULL, 10);
+				break;
+			case 'i':
+				interval = strtod(optarg, NULL);
+				break;
+			default:
+				usage(argv[0]);
+				exit(2);
+		}
+	}
+
+	if ((rows < 2) || (interval < 0)) {
+		usage(argv[0]);
+		exit(2);
+	}
+
+	map = write_map(rows);
+
+	printf("%u rows, a key every %.1f ms\n\n", rows, interval);
+	printf("%-18s %6s %9s %9s %9s %9s %10s %9s\n",
+			"variant", "frames", "mean ms", "p50 jit", "p99 jit", "max jit", "drift ms", "keys");
+
+	for (i = 0; i < VARIANTS; i++) {
+		/* without names all of them are measured */
+		found = (optind == argc);
+		for (j = optind; j < argc; j++) {
+			found |= !strcmp(argv[j], variants[i].name);
+		}
+		if (found && (bench(&variants[i], map, rows, interval) < 0)) {
+			result = 1;
+		}
+	}
+
+	unlink(map);
+	free(map);
+	return result;
+}
+
+char*
+write_map(unsigned int rows)
+{
+	char* name = strdup("/tmp/frame_bench.XXXXXX");
+	FILE* map;
+	int fd;
+	unsigned int i;
+
+	fd = mkstemp(name);
+	if ((fd < 0) || ((map = fdopen(fd, "w")) == NULL)) {
+		perror("mkstemp");
+		exit(3);
+	}
+
+	fprintf(map, "(%u)(%u)\n", TRACK_SIZE, TRACK_SIZE / 2);
+	for (i = 0; i < rows; i++) {
+		fprintf(map, "%u %u\n", TRACK_SIZE / 4, TRACK_SIZE - TRACK_SIZE / 4);
+	}
+
+	if (fclose(map) != 0) {
+		perror("fclose");
+		exit(3);
+	}
+	return name;
+}
+
+int
+bench(const struct variant* variant, const char* map, unsigned int rows, double interval)
+{
+	char path[BUFFLEN];
+	char buffer[BUFFLEN];
+	char line[BUFFLEN];
+	char keybuf[BUFFLEN];
+	size_t linelen = 0;
+	size_t due;
+	ssize_t sent;
+	double* stamps;
+	double* jitter;
+	unsigned int frames = 0;
+	double next_key;
+	double key_end;
+	double deadline;
+	double now;
+	double mean;
+	double drift;
+	struct pollfd pfd;
+	ssize_t got;
+	ssize_t k;
+	int timeout;
+	unsigned long keys = 0;
+	unsigned long read_keys = 0;
+	unsigned long applied = 0;
+	unsigned long dropped = 0;
+	unsigned long left = 0;
+	long lost = 0;
+	unsigned long disorder = 0;
+	int counted = 0;
+	int fd;
+	int status;
+	unsigned int i;
+	pid_t pid;
+
+	stamps = malloc(sizeof(double) * (rows + 1));
+	jitter = malloc(sizeof(double) * (rows + 1));
+	if ((stamps == NULL) || (jitter == NULL)) {
+		printf("Not enough memory.\n");
+		exit(4);
+	}
+
+	snprintf(path, sizeof(path), "./%s", variant->name);
+
+	pid = forkpty(&fd, NULL, NULL, NULL);
+	if (pid < 0) {
+		perror("forkpty");
+		exit(1);
+	}
+	if (pid == 0) {
+		execl(path, path, map, (char*)NULL);
+		perror(path);
+		_exit(127);
+	}
+
+	/* give up on racers that hang */
+	deadline = now_ms() + START_DELAY_MS + 3.0 * rows * variant->period + 5000.0;
+	next_key = now_ms() + START_DELAY_MS;
+	key_end = next_key + (rows - ((rows > KEY_STOP_ROWS) ? KEY_STOP_ROWS : 0)) * variant->period;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	while (1) {
+		now = now_ms();
+		if (now > deadline) {
+			printf("%-18s did not finish in time\n", variant->name);
+			kill(pid, SIGKILL);
+			break;
+		}
+
+		/* scripted input, left and right in turns, all keys due at once */
+		if ((interval > 0) && (now >= next_key) && (now < key_end)) {
+			due = (size_t)((now - next_key) / interval) + 1;
+			if (due > sizeof(keybuf)) {
+				due = sizeof(keybuf);
+			}
+			for (i = 0; i < due; i++) {
+				keybuf[i] = ((keys + i) & 1) ? 'k' : 'j';
+			}
+			/* a full pty drops the keys instead of stalling the measurement */
+			sent = write(fd, keybuf, due);
+			if (sent > 0) {
+				keys += sent;
+			}
+			next_key += due * interval;
+			if (next_key < now) {
+				next_key = now + interval;
+			}
+		}
+
+		timeout = ((interval > 0) && (next_key < key_end)) ? (int)ceil(next_key - now) : 100;
+		if (timeout < 0) {
+			timeout = 0;
+		}
+		if (poll(&pfd, 1, timeout) < 0) {
+			perror("poll");
+			break;
+		}
+		if (!(pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+			continue;
+		}
+
+		got = read(fd, buffer, sizeof(buffer));
+		now = now_ms();
+		if ((got < 0) && (errno == EAGAIN)) {
+			continue;
+		}
+		/* EIO once the racer is gone */
+		if (got <= 0) {
+			break;
+		}
+
+		for (k = 0; k < got; k++) {
+			if (buffer[k] != '\n') {
+				if (linelen < sizeof(line) - 1) {
+					line[linelen++] = buffer[k];
+				}
+				continue;
+			}
+			line[linelen] = '\0';
+			linelen = 0;
+
+			/* track rows, not the header or the messages */
+			if ((line[0] == '|') && strchr(line, '#') && (frames <= rows)) {
+				stamps[frames++] = now;
+			}
+			else if (sscanf(line, KEYS_FORMAT, &read_keys, &applied, &dropped,
+						&left, &lost, &disorder) == 6) {
+				counted = 1;
+			}
+		}
+	}
+
+	close(fd);
+	waitpid(pid, &status, 0);
+
+	if (frames < 2) {
+		printf("%-18s only %u rows seen\n", variant->name, frames);
+		free(stamps);
+		free(jitter);
+		return -1;
+	}
+
+	mean = (stamps[frames - 1] - stamps[0]) / (frames - 1);
+	drift = (stamps[frames - 1] - stamps[0]) - (frames - 1) * variant->period;
+	for (i = 1; i < frames; i++) {
+		jitter[i - 1] = fabs((stamps[i] - stamps[i - 1]) - variant->period);
+	}
+	qsort(jitter, frames - 1, sizeof(double), compare_double);
+
+	printf("%-18s %6u %9.2f %9.2f %9.2f %9.2f %10.2f %9lu\n",
+			variant->name, frames, mean,
+			jitter[(frames - 2) / 2],
+			jitter[(unsigned int)ceil(0.99 * (frames - 1)) - 1],
+			jitter[frames - 2],
+			drift, keys);
+
+	free(stamps);
+	free(jitter);
+
+	if (!counted) {
+		return 0;
+	}
+	printf("%-18s %lu keys sent, %lu read, %lu applied, %lu dropped, %lu left, %ld lost, "\
+			"%lu out of order: %s\n", "", keys, read_keys, applied, dropped, left, lost, disorder,
+			((read_keys == keys) && (lost == 0) && (disorder == 0)) ? "ok" : "FAILED");
+	return ((read_keys == keys) && (lost == 0) && (disorder == 0)) ? 0 : -1;
+}
+
+double
+now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+int
+compare_double(const void* a, const void* b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+void
+usage(const char* name)
+{
+	printf("Usage: %s [-r rows] [-i interval] [variant ...]\n"\
+		   "       -r rows of the benchmark track (default 50)\n"\
+		   "       -i ms between the scripted keys, 0 for none (default 40)\n"\
+		   "       variants: term_racer term_racer_simple thread_racer (default all)\n", name);
+}
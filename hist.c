@@ -0,0 +1,114 @@
+/**
+ * hist
+ *
+ * Histograms of times with fixed buckets, in the manner of HdrHistogram:
+ * every power of two is split in HIST_SUB buckets, so any value is kept
+ * to about 3% without a bucket per nanosecond. Recording is a few
+ * instructions and never allocates.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <string.h>
+
+#include "hist.h"
+
+/* the percentiles of the reports */
+static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+
+/**
+ * The highest value that goes to a bucket.
+ */
+static unsigned long long
+bucket_high(unsigned int bucket)
+{
+	unsigned int shift = (bucket < 2 * HIST_SUB) ? 0 : bucket / HIST_SUB - 1;
+
+	return ((unsigned long long)(bucket - shift * HIST_SUB + 1) << shift) - 1;
+}
+
+void
+hist_init(struct hist* hist, const char* name)
+{
+	memset(hist, 0, sizeof(*hist));
+	hist->name = name;
+}
+
+unsigned long long
+hist_percentile(const struct hist* hist, double percentile)
+{
+	unsigned long long wanted;
+	unsigned long long seen = 0;
+	unsigned int i;
+
+	if (hist->count == 0) {
+		return 0;
+	}
+
+	/* at least one value, the smallest for 0 */
+	wanted = (unsigned long long)(percentile / 100.0 * hist->count + 0.5);
+	if (wanted < 1) {
+		wanted = 1;
+	}
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen >= wanted) {
+			/* the bucket may reach above what was seen */
+			return (bucket_high(i) < hist->max) ? bucket_high(i) : hist->max;
+		}
+	}
+	return hist->max;
+}
+
+void
+hist_report(const struct hist* hist, FILE* stream)
+{
+	unsigned int i;
+
+	fprintf(stream, "%s: %lu", hist->name, hist->count);
+	if (hist->count == 0) {
+		fprintf(stream, "\n");
+		return;
+	}
+	fprintf(stream, ", min %.3f", hist->min / 1e6);
+	for (i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+		fprintf(stream, ", p%g %.3f", percentiles[i], hist_percentile(hist, percentiles[i]) / 1e6);
+	}
+	fprintf(stream, ", max %.3f, mean %.3f ms\n", hist->max / 1e6, (double)hist->sum / hist->count / 1e6);
+}
+
+int
+hist_dump(const struct hist* hist, FILE* out)
+{
+	unsigned long seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		if (hist->buckets[i] == 0) {
+			continue;
+		}
+		seen += hist->buckets[i];
+		if (fprintf(out, "%s\t%llu\t%lu\t%.6f\n", hist->name, bucket_high(i),
+					hist->buckets[i], (double)seen / hist->count) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
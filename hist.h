@@ -0,0 +1,134 @@
+/**
+ * hist
+ *
+ * Histograms of times with fixed buckets, in the manner of HdrHistogram:
+ * every power of two is split in HIST_SUB buckets, so any value is kept
+ * to about 3% without a bucket per nanosecond. Recording is a few
+ * instructions and never allocates.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdio.h>
+#include <time.h>
+
+/* buckets per power of two, as bits */
+#define HIST_SUB_BITS 5
+#define HIST_SUB      (1u << HIST_SUB_BITS)
+
+/* values up to 2^36 ns (about a minute), larger ones go to the last bucket */
+#define HIST_MAX_BITS 36
+#define HIST_BUCKETS  ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+/**
+ * A histogram of times in nanoseconds.
+ */
+struct hist {
+	const char* name;
+	unsigned long count;
+	unsigned long long min;
+	unsigned long long max;
+	unsigned long long sum;
+	unsigned long buckets[HIST_BUCKETS];
+};
+
+/**
+ * The bucket of a value: the values below 2 * HIST_SUB have one each,
+ * above that the HIST_SUB_BITS bits after the highest one set count.
+ */
+static inline unsigned int
+hist_bucket(unsigned long long value)
+{
+	unsigned int shift = 0;
+	unsigned int bucket;
+
+	if (value >= HIST_SUB) {
+		shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+	}
+	bucket = shift * HIST_SUB + (unsigned int)(value >> shift);
+	return (bucket < HIST_BUCKETS) ? bucket : HIST_BUCKETS - 1;
+}
+
+/**
+ * Counts a value, negative ones as 0.
+ */
+static inline void
+hist_record(struct hist* hist, long long value)
+{
+	unsigned long long v = (value > 0) ? (unsigned long long)value : 0;
+
+	hist->buckets[hist_bucket(v)]++;
+	if ((hist->count == 0) || (v < hist->min)) {
+		hist->min = v;
+	}
+	if (v > hist->max) {
+		hist->max = v;
+	}
+	hist->sum += v;
+	hist->count++;
+}
+
+/**
+ * The nanoseconds from one time to another, negative if it is earlier.
+ */
+static inline long long
+hist_elapsed(const struct timespec* from, const struct timespec* to)
+{
+	return (to->tv_sec - from->tv_sec) * 1000000000LL + (to->tv_nsec - from->tv_nsec);
+}
+
+/**
+ * Starts an empty histogram.
+ *
+ * @param name What is measured, for the reports.
+ */
+void
+hist_init(struct hist* hist, const char* name);
+
+/**
+ * The value a share of the values are at or below, the highest value of
+ * its bucket.
+ *
+ * @param percentile 0 to 100.
+ */
+unsigned long long
+hist_percentile(const struct hist* hist, double percentile);
+
+/**
+ * Prints a line with the percentiles, in milliseconds.
+ */
+void
+hist_report(const struct hist* hist, FILE* stream);
+
+/**
+ * Writes every bucket that counted something, a line each and the
+ * fields separated by tabs: the name, the highest value of the bucket in
+ * nanoseconds, the values in it and the share of all values at or below
+ * it.
+ *
+ * @return 0 on success, -1 on a write error.
+ */
+int
+hist_dump(const struct hist* hist, FILE* out);
+
+#endif
@@ -0,0 +1,378 @@
+/**
+ * index
+ *
+ * Checkpoints every few rows of a map, kept next to it in <map>.idx.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+
+#include "index.h"
+
+static void
+put_le(unsigned char* p, unsigned long long v, unsigned int bytes)
+{
+	unsigned int i;
+
+	for (i = 0; i < bytes; i++) {
+		p[i] = (v >> (8 * i)) & 0xff;
+	}
+}
+
+static unsigned long long
+get_le(const unsigned char* p, unsigned int bytes)
+{
+	unsigned long long v = 0;
+	unsigned int i;
+
+	for (i = 0; i < bytes; i++) {
+		v |= (unsigned long long)p[i] << (8 * i);
+	}
+	return v;
+}
+
+/**
+ * The name of the index of a map, free it when done.
+ */
+static char*
+index_name(const char* mapname)
+{
+	char* name = malloc(strlen(mapname) + 5);
+
+	if (name != NULL) {
+		strcpy(name, mapname);
+		strcat(name, ".idx");
+	}
+	return name;
+}
+
+/**
+ * Adds a checkpoint, the array grows as needed.
+ *
+ * @return 0 on success, -1 without memory.
+ */
+static int
+add_point(struct track_index* index, unsigned int* capacity, const struct track_checkpoint* point)
+{
+	struct track_checkpoint* grown;
+
+	if (index->count == *capacity) {
+		*capacity = *capacity ? *capacity * 2 : 64;
+		grown = realloc(index->points, sizeof(*grown) * *capacity);
+		if (grown == NULL) {
+			return -1;
+		}
+		index->points = grown;
+	}
+	index->points[index->count++] = *point;
+	return 0;
+}
+
+/**
+ * Finds where the rows of a text map start, the same lines track_load
+ * takes as rows.
+ */
+static int
+index_text(FILE* map, struct track_index* index, unsigned int* capacity)
+{
+	struct track_checkpoint point;
+	char* line = NULL;
+	size_t linesize = 0;
+	const char* p;
+	off_t offset;
+
+	memset(&point, 0, sizeof(point));
+	point.line = 1;
+
+	rewind(map);
+	if (getline(&line, &linesize, map) < 0) {
+		free(line);
+		return -1;
+	}
+
+	while (offset = ftello(map), getline(&line, &linesize, map) >= 0) {
+		point.line++;
+
+		/* empty lines are no rows */
+		for (p = line; isspace((unsigned char)*p); p++);
+		if (*p == '\0') {
+			continue;
+		}
+
+		if (point.row % index->stride == 0) {
+			point.offset = offset;
+			if (add_point(index, capacity, &point) < 0) {
+				free(line);
+				return -1;
+			}
+		}
+		point.row++;
+	}
+	index->rows = point.row;
+
+	free(line);
+	return 0;
+}
+
+unsigned int
+index_build(FILE* map, unsigned int stride, struct track_index* index)
+{
+	struct track track;
+	struct track_cursor cursor;
+	struct track_cursor ahead;
+	struct track_checkpoint point;
+	unsigned int capacity = 0;
+	unsigned int left;
+	unsigned int right;
+	unsigned int errors;
+	int result = 0;
+
+	memset(index, 0, sizeof(*index));
+	index->stride = stride;
+
+	/* only maps the racers accept get an index */
+	errors = track_load(map, &track);
+	if (errors) {
+		track_free(&track);
+		return errors;
+	}
+
+	if (track.format == TRACK_TEXT) {
+		result = index_text(map, index, &capacity);
+	}
+	else {
+		memset(&point, 0, sizeof(point));
+		track_cursor_init(&cursor, &track);
+		ahead = cursor;
+		while ((result == 0) && track_next(&ahead, &left, &right)) {
+			if (cursor.row % stride == 0) {
+				/* the cursor as it is before reading the row */
+				point.row = cursor.row;
+				point.offset = TRACK_HEADER_SIZE + ((track.format == TRACK_DELTA)
+						? (size_t)(cursor.pos - track.data)
+						: 2 * track.width * (size_t)cursor.row);
+				point.left = cursor.left;
+				point.right = cursor.right;
+				point.dleft = cursor.dleft;
+				point.dright = cursor.dright;
+				point.run = cursor.run;
+				result = add_point(index, &capacity, &point);
+			}
+			cursor = ahead;
+		}
+		index->rows = track.rows;
+	}
+
+	track_free(&track);
+	if (result < 0) {
+		printf("Could not index the map file.\n");
+		return 1;
+	}
+	return 0;
+}
+
+int
+index_save(const char* mapname, const struct track_index* index)
+{
+	unsigned char header[INDEX_HEADER_SIZE];
+	unsigned char entry[INDEX_ENTRY_SIZE];
+	const struct track_checkpoint* point;
+	struct stat st;
+	char* name;
+	FILE* out;
+	unsigned int i;
+	int result = 0;
+
+	name = index_name(mapname);
+	if ((name == NULL) || (stat(mapname, &st) < 0) || ((out = fopen(name, "w")) == NULL)) {
+		free(name);
+		return -1;
+	}
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, INDEX_MAGIC, 4);
+	put_le(header + 4, INDEX_VERSION, 4);
+	put_le(header + 8, index->stride, 4);
+	put_le(header + 12, index->count, 4);
+	put_le(header + 16, st.st_size, 8);
+	put_le(header + 24, st.st_mtim.tv_sec, 8);
+	put_le(header + 32, st.st_mtim.tv_nsec, 8);
+	put_le(header + 40, index->rows, 4);
+	if (fwrite(header, 1, sizeof(header), out) != sizeof(header)) {
+		result = -1;
+	}
+
+	for (i = 0; (result == 0) && (i < index->count); i++) {
+		point = &index->points[i];
+		put_le(entry, point->row, 4);
+		put_le(entry + 4, point->line, 4);
+		put_le(entry + 8, point->offset, 8);
+		put_le(entry + 16, point->left, 4);
+		put_le(entry + 20, point->right, 4);
+		put_le(entry + 24, (unsigned int)point->dleft, 4);
+		put_le(entry + 28, (unsigned int)point->dright, 4);
+		put_le(entry + 32, point->run, 4);
+		if (fwrite(entry, 1, sizeof(entry), out) != sizeof(entry)) {
+			result = -1;
+		}
+	}
+
+	if (fclose(out) != 0) {
+		result = -1;
+	}
+	free(name);
+	return result;
+}
+
+int
+index_load(const char* mapname, struct track_index* index)
+{
+	unsigned char header[INDEX_HEADER_SIZE];
+	unsigned char entry[INDEX_ENTRY_SIZE];
+	struct track_checkpoint* point;
+	struct stat st;
+	char* name;
+	FILE* in;
+	unsigned int i;
+
+	memset(index, 0, sizeof(*index));
+
+	name = index_name(mapname);
+	if ((name == NULL) || (stat(mapname, &st) < 0) || ((in = fopen(name, "r")) == NULL)) {
+		free(name);
+		return -1;
+	}
+	free(name);
+
+	/* an index of another version of the map is of no use */
+	if ((fread(header, 1, sizeof(header), in) != sizeof(header))
+			|| memcmp(header, INDEX_MAGIC, 4)
+			|| (get_le(header + 4, 4) != INDEX_VERSION)
+			|| (get_le(header + 16, 8) != (unsigned long long)st.st_size)
+			|| (get_le(header + 24, 8) != (unsigned long long)st.st_mtim.tv_sec)
+			|| (get_le(header + 32, 8) != (unsigned long long)st.st_mtim.tv_nsec)) {
+		fclose(in);
+		return -1;
+	}
+
+	/* without a checkpoint, not even the first row, it leads nowhere */
+	index->stride = get_le(header + 8, 4);
+	index->count = get_le(header + 12, 4);
+	index->rows = get_le(header + 40, 4);
+	if ((index->stride == 0) || (index->count == 0)) {
+		fclose(in);
+		index->count = 0;
+		return -1;
+	}
+	index->points = malloc(sizeof(*index->points) * index->count);
+	if (index->points == NULL) {
+		fclose(in);
+		index_free(index);
+		return -1;
+	}
+
+	for (i = 0; i < index->count; i++) {
+		if (fread(entry, 1, sizeof(entry), in) != sizeof(entry)) {
+			fclose(in);
+			index_free(index);
+			return -1;
+		}
+		point = &index->points[i];
+		point->row = get_le(entry, 4);
+		point->line = get_le(entry + 4, 4);
+		point->offset = get_le(entry + 8, 8);
+		point->left = get_le(entry + 16, 4);
+		point->right = get_le(entry + 20, 4);
+		point->dleft = (int)get_le(entry + 24, 4);
+		point->dright = (int)get_le(entry + 28, 4);
+		point->run = get_le(entry + 32, 4);
+	}
+
+	fclose(in);
+	return 0;
+}
+
+void
+index_free(struct track_index* index)
+{
+	free(index->points);
+	index->points = NULL;
+	index->count = 0;
+}
+
+unsigned int
+index_open(FILE* map, const char* mapname, unsigned int row,
+		struct track* track, struct track_cursor* cursor, int* xpos)
+{
+	struct track_index index;
+	struct track_checkpoint* point = NULL;
+	struct track_cursor ahead;
+	unsigned int errors;
+	unsigned int left;
+	unsigned int right;
+
+	if (row == 0) {
+		errors = track_open(map, track);
+		track_cursor_init(cursor, track);
+		*xpos = track->startpos;
+		return errors;
+	}
+
+	if (index_load(mapname, &index) == 0) {
+		point = &index.points[(row / index.stride < index.count) ? row / index.stride : index.count - 1];
+	}
+	else {
+		printf("There is no index of %s as it is now, reading the rows before row %u.\n",
+				mapname, row + 1);
+	}
+
+	if (point != NULL) {
+		errors = track_load_at(map, track, point, index.rows);
+		if (!errors) {
+			track_cursor_seek(cursor, track, point);
+		}
+	}
+	else {
+		errors = track_open(map, track);
+		track_cursor_init(cursor, track);
+	}
+	index_free(&index);
+	if (errors) {
+		return errors;
+	}
+
+	/* from the checkpoint on it is less than a stride */
+	while ((cursor->row + track->first < row) && track_next(cursor, &left, &right));
+
+	ahead = *cursor;
+	if ((cursor->row + track->first < row) || !track_next(&ahead, &left, &right)) {
+		printf("The map file has no row %u.\n", row + 1);
+		return 1;
+	}
+	*xpos = (left + right) / 2;
+	return 0;
+}
@@ -0,0 +1,113 @@
+/**
+ * index
+ *
+ * Checkpoints every few rows of a map, kept next to it in <map>.idx,
+ * so a race can start anywhere on a long track.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdio.h>
+
+#include "track.h"
+
+/*
+ * The index file, all numbers little endian:
+ *
+ *   magic "TRKI", version (4 bytes), the stride, the number of
+ *   checkpoints (4 bytes each), the size and the modification time
+ *   (seconds and nanoseconds) of the map (8 bytes each), the rows of
+ *   the map and 4 reserved bytes, followed by
+ *   the checkpoints: row, line (4 bytes each), offset (8 bytes), left,
+ *   right, dleft, dright and run (4 bytes each).
+ */
+#define INDEX_MAGIC       "TRKI"
+#define INDEX_VERSION     2
+#define INDEX_HEADER_SIZE 48
+#define INDEX_ENTRY_SIZE  36
+
+/* rows between the checkpoints if nothing else is asked for */
+#define INDEX_STRIDE 4096
+
+/**
+ * The checkpoints of a map, one every stride rows starting with row 0.
+ */
+struct track_index {
+	unsigned int stride;
+	unsigned int count;
+	/* rows of the whole map */
+	unsigned int rows;
+	struct track_checkpoint* points;
+};
+
+/**
+ * Collects the checkpoints of a map, it is read once from the start.
+ *
+ * @param map The map file, it is loaded again from its start.
+ *
+ * @return the number of errors found in the map, 0 on success.
+ */
+unsigned int
+index_build(FILE* map, unsigned int stride, struct track_index* index);
+
+/**
+ * Writes the index of a map to <mapname>.idx, stamped with the size and
+ * the time the map was last modified.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int
+index_save(const char* mapname, const struct track_index* index);
+
+/**
+ * Reads the index of a map from <mapname>.idx.
+ *
+ * @return 0 on success, -1 if there is none, it has no checkpoint or it
+ *         does not belong to the map as it is now.
+ */
+int
+index_load(const char* mapname, struct track_index* index);
+
+/**
+ * Releases the checkpoints.
+ */
+void
+index_free(struct track_index* index);
+
+/**
+ * Opens a map like track_open and places a cursor on a row, through the
+ * index if the map has a fresh one, else by reading the rows before.
+ *
+ * @param mapname Where the index is looked for.
+ * @param row The row to start in, counted from 0.
+ * @param cursor Set so the next row is the start row.
+ * @param xpos Set to the middle of the road in the start row, the
+ *        start position of the track for row 0.
+ *
+ * @return the number of errors found, 0 if the race can start.
+ */
+unsigned int
+index_open(FILE* map, const char* mapname, unsigned int row,
+		struct track* track, struct track_cursor* cursor, int* xpos);
+
+#endif
@@ -0,0 +1,102 @@
+/**
+ * input
+ *
+ * Turning keys into steering events and steering events into moves.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <string.h>
+
+#include "input.h"
+
+int
+input_policy(const char* name)
+{
+	if (!strcmp(name, "latest")) {
+		return INPUT_LATEST;
+	}
+	if (!strcmp(name, "net")) {
+		return INPUT_NET;
+	}
+	if (!strcmp(name, "queue")) {
+		return INPUT_QUEUE;
+	}
+	return -1;
+}
+
+int
+input_parse(const char* keys, size_t count, const struct timespec* stamp, struct input_ring* ring)
+{
+	struct input_event event;
+	size_t i;
+
+	event.stamp = *stamp;
+	event.seq = 0;
+	for (i = 0; i < count; i++) {
+		if (keys[i] == 'j') {
+			event.dx = -1;
+			input_ring_push(ring, &event);
+		}
+		else if (keys[i] == 'k') {
+			event.dx = 1;
+			input_ring_push(ring, &event);
+		}
+		/* Picard on holo deck: "Computer, exit!" */
+		else if (keys[i] == 'Q') {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int
+input_coalesce(struct input_ring* ring, int policy, struct input_event* applied)
+{
+	struct input_event event;
+	int count = 0;
+	int net = 0;
+	int last = 0;
+
+	if (policy == INPUT_QUEUE) {
+		if (!input_ring_pop(ring, &event)) {
+			return 0;
+		}
+		*applied = event;
+		return event.dx;
+	}
+
+	while (input_ring_pop(ring, &event)) {
+		if (count++ == 0) {
+			*applied = event;
+		}
+		net += event.dx;
+		last = event.dx;
+	}
+
+	if (policy == INPUT_NET) {
+		last = (net > 0) - (net < 0);
+	}
+	/* keys that add up to nothing did not steer the frame */
+	if (last == 0) {
+		applied->dx = 0;
+	}
+	return last;
+}
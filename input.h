@@ -0,0 +1,148 @@
+/**
+ * input
+ *
+ * Timestamped steering events and a lock free channel to pass them
+ * from an input thread to the game loop.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <time.h>
+
+/* events the channel can hold, a power of two */
+#define INPUT_RING_SIZE 256u
+
+/* what a frame makes of the keys pressed since the last one */
+#define INPUT_LATEST 0
+#define INPUT_NET    1
+#define INPUT_QUEUE  2
+
+/**
+ * A key that steers, stamped when it was read.
+ */
+struct input_event {
+	struct timespec stamp;
+	/* -1 left, 1 right */
+	int dx;
+	/* the number of the key, if the reader counts them, else 0 */
+	unsigned long seq;
+};
+
+/**
+ * Single producer, single consumer ring of input events.
+ *
+ * Only the input thread pushes and only the game loop pops, neither
+ * of them ever waits for the other one.
+ */
+struct input_ring {
+	/* next slot to write, only changed by the producer */
+	_Alignas(64) atomic_uint head;
+	/* next slot to read, only changed by the consumer */
+	_Alignas(64) atomic_uint tail;
+	/* events lost because the ring was full, producer only, read it
+	   when the producer is done */
+	_Alignas(64) unsigned long dropped;
+	struct input_event events[INPUT_RING_SIZE];
+};
+
+/**
+ * Adds an event, called by the producer only.
+ *
+ * @return 0 on success, -1 if the ring is full and the event was dropped.
+ */
+static inline int
+input_ring_push(struct input_ring* ring, const struct input_event* event)
+{
+	unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	if (head - tail == INPUT_RING_SIZE) {
+		ring->dropped++;
+		return -1;
+	}
+
+	ring->events[head & (INPUT_RING_SIZE - 1)] = *event;
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+	return 0;
+}
+
+/**
+ * Takes the oldest event, called by the consumer only.
+ *
+ * @return 1 if there was an event, 0 if the ring is empty.
+ */
+static inline int
+input_ring_pop(struct input_ring* ring, struct input_event* event)
+{
+	unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+	if (head == tail) {
+		return 0;
+	}
+
+	*event = ring->events[tail & (INPUT_RING_SIZE - 1)];
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+	return 1;
+}
+
+/**
+ * Finds a coalescing policy by its name: "latest", "net" or "queue".
+ *
+ * @return INPUT_LATEST, INPUT_NET or INPUT_QUEUE, -1 if unknown.
+ */
+int
+input_policy(const char* name);
+
+/**
+ * Turns the keys read at once into steering events.
+ *
+ * @param keys The bytes read from the terminal.
+ * @param count Number of bytes.
+ * @param stamp When they were read.
+ * @param ring The events go there, they are dropped if it is full.
+ *
+ * @return 1 if a 'Q' was among them, else 0.
+ */
+int
+input_parse(const char* keys, size_t count, const struct timespec* stamp, struct input_ring* ring);
+
+/**
+ * Applies the coalescing policy at the end of a frame.
+ *
+ * INPUT_LATEST steers one column in the direction of the last key,
+ * INPUT_NET one column in the direction all keys add up to and
+ * INPUT_QUEUE takes the oldest key and keeps the others for the next
+ * frames. Every other key is dropped, they do not pile up.
+ *
+ * @param applied Set to the oldest event used up by this frame if the
+ * frame steers, its dx is 0 if it does not.
+ *
+ * @return the steering of the frame, -1, 0 or 1.
+ */
+int
+input_coalesce(struct input_ring* ring, int policy, struct input_event* applied);
+
+#endif
@@ -0,0 +1,127 @@
+/**
+ * map_convert
+ *
+ * Converts maps between the text, the binary and the delta format.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "track.h"
+
+/**
+ * Prints how to call the converter.
+ */
+void
+usage(const char* name);
+
+int main(int argc, char** argv)
+{
+	FILE* in;
+	FILE* out;
+	struct track track;
+	int format = -1;
+	int result;
+	int c;
+
+	while ((c = getopt(argc, argv, "tbd")) != -1) {
+		switch (c) {
+			case 't':
+				format = TRACK_TEXT;
+				break;
+			case 'b':
+				format = TRACK_BINARY;
+				break;
+			case 'd':
+				format = TRACK_DELTA;
+				break;
+			default:
+				usage(argv[0]);
+				exit(2);
+		}
+	}
+
+	if (argc - optind != 2) {
+		usage(argv[0]);
+		exit(2);
+	}
+
+	in = fopen(argv[optind], "r");
+	if (in == NULL) {
+		printf("Could not open map file %s.\n", argv[optind]);
+		exit(3);
+	}
+
+	if (track_load(in, &track)) {
+		printf("Not converting %s, it has errors.\n", argv[optind]);
+		fclose(in);
+		track_free(&track);
+		exit(3);
+	}
+	fclose(in);
+
+	/* without an option it goes the other way round, packed becomes text */
+	if (format == -1) {
+		format = (track.format == TRACK_TEXT) ? TRACK_BINARY : TRACK_TEXT;
+	}
+
+	out = fopen(argv[optind + 1], "w");
+	if (out == NULL) {
+		printf("Could not open output file %s.\n", argv[optind + 1]);
+		track_free(&track);
+		exit(3);
+	}
+
+	if (format == TRACK_TEXT) {
+		result = track_save_text(out, &track);
+	}
+	else if (format == TRACK_BINARY) {
+		result = track_save_binary(out, &track);
+	}
+	else {
+		result = track_save_delta(out, &track);
+	}
+
+	if ((fclose(out) != 0) || (result < 0)) {
+		printf("There was an error writing the map file %s.\n", argv[optind + 1]);
+		track_free(&track);
+		exit(7);
+	}
+
+	printf("Converted %u rows to the %s format.\n", track.rows,
+			(format == TRACK_TEXT) ? "text" : (format == TRACK_BINARY) ? "binary" : "delta");
+
+	track_free(&track);
+	return 0;
+}
+
+void
+usage(const char* name)
+{
+	printf("Usage: %s [-t|-b|-d] <input map> <output map>\n"\
+		   "       -t write the text format\n"\
+		   "       -b write the binary format\n"\
+		   "       -d write the delta compressed format\n"\
+		   "       (default: text becomes binary, binary and delta become text)\n", name);
+}
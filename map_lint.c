@@ -0,0 +1,730 @@
+/**
+ * map_lint
+ *
+ * Checks text maps, or directories full of them, on all processors and
+ * reports every problem with its line, like a compiler does.
+ *
+ * Large maps are split into chunks that are read in parallel, a line
+ * belongs to the chunk its first byte is in. What the chunks find is
+ * put together in the order of the files and lines afterwards, so the
+ * report is the same whichever worker read what.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#define _DEFAULT_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "pool.h"
+
+/* the narrowest gap the editors allow */
+#define GAP_MIN 3
+
+/* the widest track that fits two bytes per margin, like track.c */
+#define SIZE_MAX_TRACK 65536u
+
+/* bytes of a map read by one task, in kB */
+#define CHUNK_KB (64 * 1024)
+
+/* what can be wrong */
+#define PROBLEM_HEADER   0
+#define PROBLEM_SIZE     1
+#define PROBLEM_STARTPOS 2
+#define PROBLEM_NOROWS   3
+#define PROBLEM_SYNTAX   4
+#define PROBLEM_BOUNDS   5
+#define PROBLEM_NARROW   6
+#define PROBLEM_JUMP     7
+#define PROBLEM_START    8
+#define PROBLEM_READ     9
+#define PROBLEM_FORMAT   10
+
+/**
+ * A problem found, the message is only put together when it is printed.
+ */
+struct problem {
+	/* the line, counted from the start of the chunk while reading */
+	unsigned long long line;
+	unsigned int kind;
+	unsigned int values[4];
+};
+
+/**
+ * A map to check.
+ */
+struct map {
+	char* name;
+	unsigned int size;
+	unsigned int startpos;
+	/* a problem that leaves nothing else to check, PROBLEM_HEADER etc., or -1 */
+	int fatal;
+	/* an open pipe, read as a single chunk, else the chunks open the file */
+	FILE* stream;
+	/* the chunks of the map, one after another */
+	size_t chunk;
+	size_t chunks;
+};
+
+/**
+ * A part of a map, read by one task.
+ */
+struct chunk {
+	/* the number of the map */
+	size_t map;
+	/* the bytes [start, end) of the file, end -1 for all there is */
+	off_t start;
+	off_t end;
+	/* lines that start in the chunk */
+	unsigned long long lines;
+	unsigned long long rows;
+	/* the first and last row, for the checks across chunks */
+	unsigned long long first_line;
+	unsigned int first[2];
+	unsigned int last[2];
+	/* whether the road of the first and last row can be driven on */
+	int first_good;
+	int last_good;
+	int have_rows;
+	/* kept up to the limit, all are counted */
+	struct problem* problems;
+	size_t count;
+	size_t kept;
+	size_t capacity;
+};
+
+/**
+ * Everything the workers need, they only write their own chunk.
+ */
+struct lint {
+	struct map* maps;
+	size_t nmaps;
+	size_t mapcapacity;
+	struct chunk* chunks;
+	size_t nchunks;
+	size_t chunkcapacity;
+	unsigned int gap;
+	/* problems reported per map at most, 0 for all */
+	unsigned long limit;
+};
+
+/**
+ * Prints how to call the linter.
+ */
+void
+usage(const char* name);
+
+/**
+ * Adds a file, or every map in a directory and below.
+ *
+ * @param named Whether the file was named on the command line, those
+ *        are checked whatever they are called.
+ */
+void
+add_path(struct lint* lint, const char* path, int named, off_t chunksize);
+
+/**
+ * Reads the header of a map and splits the rest into chunks.
+ */
+void
+add_map(struct lint* lint, const char* path, off_t chunksize);
+
+/**
+ * Checks the rows of a chunk, a task of the pool.
+ */
+void
+lint_chunk(void* context, size_t task);
+
+/**
+ * Prints the problems of a map in the order of the lines, together with
+ * the ones between its chunks.
+ *
+ * @return the number of problems.
+ */
+unsigned long
+report_map(struct lint* lint, struct map* map);
+
+int main(int argc, char** argv)
+{
+	struct lint lint;
+	struct pool_stats stats;
+	struct timespec start;
+	struct timespec end;
+	unsigned int threads = 0;
+	unsigned long chunk_kb = CHUNK_KB;
+	unsigned long problems = 0;
+	unsigned long long rows = 0;
+	unsigned int bad = 0;
+	unsigned long found;
+	size_t i;
+	int c;
+
+	memset(&lint, 0, sizeof(lint));
+	lint.gap = GAP_MIN;
+
+	while ((c = getopt(argc, argv, "j:w:m:c:")) != -1) {
+		switch (c) {
+			case 'j':
+				threads = strtoul(optarg, NULL, 10);
+				break;
+			case 'w':
+				lint.gap = strtoul(optarg, NULL, 10);
+				break;
+			case 'm':
+				lint.limit = strtoul(optarg, NULL, 10);
+				break;
+			case 'c':
+				chunk_kb = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				usage(argv[0]);
+				exit(2);
+		}
+	}
+
+	if ((argc == optind) || (chunk_kb == 0)) {
+		usage(argv[0]);
+		exit(2);
+	}
+
+	for (i = optind; i < argc; i++) {
+		add_path(&lint, argv[i], 1, (off_t)chunk_kb * 1024);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (pool_run(threads, lint.nchunks, lint_chunk, &lint, &stats) < 0) {
+		printf("Not enough memory for the workers.\n");
+		exit(4);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for (i = 0; i < lint.nmaps; i++) {
+		found = report_map(&lint, &lint.maps[i]);
+		problems += found;
+		bad += (found != 0);
+	}
+	for (i = 0; i < lint.nchunks; i++) {
+		rows += lint.chunks[i].rows;
+		free(lint.chunks[i].problems);
+	}
+
+	/* apart from the report, so it stays easy to parse */
+	fprintf(stderr, "%lu problem(s) in %u of %lu map(s), %llu rows in %.3f s on %u thread(s).\n",
+			problems, bad, (unsigned long)lint.nmaps, rows,
+			(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9, stats.threads);
+
+	for (i = 0; i < lint.nmaps; i++) {
+		if (lint.maps[i].stream != NULL) {
+			fclose(lint.maps[i].stream);
+		}
+		free(lint.maps[i].name);
+	}
+	free(lint.maps);
+	free(lint.chunks);
+	return problems ? 1 : 0;
+}
+
+/**
+ * Sorting the entries of a directory with scandir, by name.
+ */
+static int
+compare_names(const struct dirent** a, const struct dirent** b)
+{
+	return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+void
+add_path(struct lint* lint, const char* path, int named, off_t chunksize)
+{
+	struct dirent** entries;
+	struct stat st;
+	size_t length;
+	char* child;
+	int count;
+	int i;
+
+	if (stat(path, &st) < 0) {
+		/* reported like a map that could not be read */
+		add_map(lint, path, chunksize);
+		return;
+	}
+
+	if (!S_ISDIR(st.st_mode)) {
+		length = strlen(path);
+		if (named || ((length > 4) && !strcmp(path + length - 4, ".map"))) {
+			add_map(lint, path, chunksize);
+		}
+		return;
+	}
+
+	/* the same order every time */
+	count = scandir(path, &entries, NULL, compare_names);
+	if (count < 0) {
+		fprintf(stderr, "Could not read the directory %s.\n", path);
+		return;
+	}
+	for (i = 0; i < count; i++) {
+		if (entries[i]->d_name[0] != '.') {
+			child = malloc(strlen(path) + strlen(entries[i]->d_name) + 2);
+			if (child == NULL) {
+				printf("Not enough memory for the map names.\n");
+				exit(4);
+			}
+			sprintf(child, "%s/%s", path, entries[i]->d_name);
+			add_path(lint, child, 0, chunksize);
+			free(child);
+		}
+		free(entries[i]);
+	}
+	free(entries);
+}
+
+/**
+ * Appends a chunk to the map added last.
+ */
+static void
+add_chunk(struct lint* lint, off_t start, off_t end)
+{
+	struct chunk* grown;
+	struct map* map = &lint->maps[lint->nmaps - 1];
+
+	if (lint->nchunks == lint->chunkcapacity) {
+		lint->chunkcapacity = lint->chunkcapacity ? 2 * lint->chunkcapacity : 64;
+		grown = realloc(lint->chunks, sizeof(*grown) * lint->chunkcapacity);
+		if (grown == NULL) {
+			printf("Not enough memory for the chunks.\n");
+			exit(4);
+		}
+		lint->chunks = grown;
+	}
+
+	memset(&lint->chunks[lint->nchunks], 0, sizeof(struct chunk));
+	/* the maps may still move, the chunks know theirs by number */
+	lint->chunks[lint->nchunks].map = lint->nmaps - 1;
+	lint->chunks[lint->nchunks].start = start;
+	lint->chunks[lint->nchunks].end = end;
+	lint->nchunks++;
+	map->chunks++;
+}
+
+void
+add_map(struct lint* lint, const char* path, off_t chunksize)
+{
+	struct map* map;
+	struct stat st;
+	char* line = NULL;
+	size_t linesize = 0;
+	FILE* file;
+	off_t rows;
+	off_t start;
+	int c;
+
+	if (lint->nmaps == lint->mapcapacity) {
+		lint->mapcapacity = lint->mapcapacity ? 2 * lint->mapcapacity : 64;
+		map = realloc(lint->maps, sizeof(*map) * lint->mapcapacity);
+		if (map == NULL) {
+			printf("Not enough memory for the maps.\n");
+			exit(4);
+		}
+		lint->maps = map;
+	}
+	map = &lint->maps[lint->nmaps++];
+	memset(map, 0, sizeof(*map));
+	map->name = strdup(path);
+	map->chunk = lint->nchunks;
+	map->fatal = -1;
+
+	file = fopen(path, "r");
+	if ((map->name == NULL) || (file == NULL)) {
+		map->fatal = PROBLEM_READ;
+		if (file != NULL) {
+			fclose(file);
+		}
+		return;
+	}
+
+	/* binary and delta maps are checked when they are converted */
+	c = getc(file);
+	if (c != '(') {
+		map->fatal = (c == EOF) ? PROBLEM_HEADER : PROBLEM_FORMAT;
+		fclose(file);
+		return;
+	}
+	ungetc(c, file);
+
+	if ((getline(&line, &linesize, file) < 0)
+			|| (sscanf(line, "(%u)(%u)", &map->size, &map->startpos) != 2)) {
+		map->fatal = PROBLEM_HEADER;
+	}
+	else if ((map->size < 2) || (map->size > SIZE_MAX_TRACK)) {
+		map->fatal = PROBLEM_SIZE;
+	}
+	else if ((map->startpos < 1) || (map->startpos >= map->size)) {
+		map->fatal = PROBLEM_STARTPOS;
+	}
+	free(line);
+	if (map->fatal >= 0) {
+		fclose(file);
+		return;
+	}
+
+	rows = ftello(file);
+	if ((fstat(fileno(file), &st) < 0) || !S_ISREG(st.st_mode) || (rows < 0)) {
+		/* a pipe can only be read once, from where the header ended */
+		map->stream = file;
+		add_chunk(lint, 0, -1);
+		return;
+	}
+	fclose(file);
+
+	start = rows;
+	do {
+		add_chunk(lint, start, (st.st_size - start > chunksize) ? start + chunksize : st.st_size);
+		start += chunksize;
+	} while (start < st.st_size);
+}
+
+/**
+ * Notes a problem of a chunk.
+ */
+static void
+add_problem(struct chunk* chunk, unsigned long limit, unsigned int kind,
+		unsigned int a, unsigned int b, unsigned int c, unsigned int d)
+{
+	struct problem* grown;
+	struct problem* problem;
+
+	chunk->count++;
+	/* more than a map reports at most are not needed */
+	if (limit && (chunk->kept >= limit)) {
+		return;
+	}
+
+	if (chunk->kept == chunk->capacity) {
+		chunk->capacity = chunk->capacity ? 2 * chunk->capacity : 16;
+		grown = realloc(chunk->problems, sizeof(*grown) * chunk->capacity);
+		if (grown == NULL) {
+			return;
+		}
+		chunk->problems = grown;
+	}
+
+	problem = &chunk->problems[chunk->kept++];
+	problem->line = chunk->lines;
+	problem->kind = kind;
+	problem->values[0] = a;
+	problem->values[1] = b;
+	problem->values[2] = c;
+	problem->values[3] = d;
+}
+
+/**
+ * Reads a margin and the blanks in front of it.
+ *
+ * @return 1 if there was a number, else 0.
+ */
+static int
+parse_margin(const char** pos, unsigned int* value)
+{
+	const char* p = *pos;
+	unsigned long result = 0;
+
+	while ((*p == ' ') || (*p == '\t')) {
+		p++;
+	}
+	if (!isdigit((unsigned char)*p)) {
+		return 0;
+	}
+	while (isdigit((unsigned char)*p)) {
+		result = result * 10 + (*p++ - '0');
+		if (result > 0xffffffffUL) {
+			result = 0xffffffffUL;
+		}
+	}
+
+	*value = result;
+	*pos = p;
+	return 1;
+}
+
+/**
+ * Whether the car can get from a row to the next one, moving one column
+ * at most: some column inside the first road has to be next to one
+ * inside the second.
+ */
+static int
+can_follow(unsigned int left, unsigned int right, unsigned int nextleft, unsigned int nextright)
+{
+	return (left < nextright) && (nextleft < right);
+}
+
+void
+lint_chunk(void* context, size_t task)
+{
+	struct lint* lint = context;
+	struct chunk* chunk = &lint->chunks[task];
+	struct map* map = &lint->maps[chunk->map];
+	FILE* file = map->stream;
+	char* line = NULL;
+	size_t linesize = 0;
+	ssize_t length;
+	const char* pos;
+	off_t offset = chunk->start;
+	unsigned int left = 0;
+	unsigned int right = 0;
+	unsigned int last[2] = { 0, 0 };
+	int good;
+	int last_good = 0;
+	int c;
+
+	if (file == NULL) {
+		file = fopen(map->name, "r");
+		if ((file == NULL) || (fseeko(file, chunk->start - 1, SEEK_SET) < 0)) {
+			add_problem(chunk, lint->limit, PROBLEM_READ, 0, 0, 0, 0);
+			if (file != NULL) {
+				fclose(file);
+			}
+			return;
+		}
+		/* a line that started in front of the chunk belongs to the one before */
+		c = getc(file);
+		if ((c != '\n') && (c != EOF)) {
+			length = getline(&line, &linesize, file);
+			offset += (length > 0) ? length : 0;
+		}
+	}
+
+	while (((chunk->end < 0) || (offset < chunk->end))
+			&& ((length = getline(&line, &linesize, file)) >= 0)) {
+		offset += length;
+		chunk->lines++;
+		pos = line;
+
+		/* empty lines are allowed */
+		while (isspace((unsigned char)*pos)) {
+			pos++;
+		}
+		if (*pos == '\0') {
+			continue;
+		}
+
+		chunk->rows++;
+		good = 0;
+		if (!parse_margin(&pos, &left) || !parse_margin(&pos, &right)) {
+			add_problem(chunk, lint->limit, PROBLEM_SYNTAX, 0, 0, 0, 0);
+		}
+		else {
+			while (isspace((unsigned char)*pos)) {
+				pos++;
+			}
+			if (*pos != '\0') {
+				add_problem(chunk, lint->limit, PROBLEM_SYNTAX, 0, 0, 0, 0);
+			}
+			else if ((left < 1) || (left >= map->size) || (right < 1) || (right >= map->size)) {
+				add_problem(chunk, lint->limit, PROBLEM_BOUNDS, left, right, map->size - 1, 0);
+			}
+			else {
+				if ((int)right - (int)left < (int)lint->gap) {
+					add_problem(chunk, lint->limit, PROBLEM_NARROW, left, right, lint->gap, 0);
+				}
+				/* without a column between the margins there is nothing to follow */
+				good = (right > left + 1);
+			}
+		}
+
+		if (!chunk->have_rows) {
+			chunk->have_rows = 1;
+			chunk->first_line = chunk->lines;
+			chunk->first[0] = left;
+			chunk->first[1] = right;
+			chunk->first_good = good;
+		}
+		else if (good && last_good && !can_follow(last[0], last[1], left, right)) {
+			add_problem(chunk, lint->limit, PROBLEM_JUMP, last[0], last[1], left, right);
+		}
+		last[0] = left;
+		last[1] = right;
+		last_good = good;
+	}
+
+	if (ferror(file)) {
+		add_problem(chunk, lint->limit, PROBLEM_READ, 0, 0, 0, 0);
+	}
+	chunk->last[0] = last[0];
+	chunk->last[1] = last[1];
+	chunk->last_good = last_good;
+
+	free(line);
+	if (file != map->stream) {
+		fclose(file);
+	}
+}
+
+/**
+ * Prints a problem.
+ */
+static void
+print_problem(const struct map* map, unsigned long long line, unsigned int kind, const unsigned int* values)
+{
+	/* problems of the whole file have no line */
+	if (line) {
+		printf("%s:%llu: ", map->name, line);
+	}
+	else {
+		printf("%s: ", map->name);
+	}
+
+	switch (kind) {
+		case PROBLEM_HEADER:
+			printf("the header is not (size)(startpos)\n");
+			break;
+		case PROBLEM_SIZE:
+			printf("the size %u is not within 2 - %u\n", map->size, SIZE_MAX_TRACK);
+			break;
+		case PROBLEM_STARTPOS:
+			printf("the start position %u does not fit the size %u\n", map->startpos, map->size);
+			break;
+		case PROBLEM_NOROWS:
+			printf("there are no rows\n");
+			break;
+		case PROBLEM_SYNTAX:
+			printf("the row is not \"left right\"\n");
+			break;
+		case PROBLEM_BOUNDS:
+			printf("the margins %u %u are not within 1 - %u\n", values[0], values[1], values[2]);
+			break;
+		case PROBLEM_NARROW:
+			printf("the margins %u %u leave a gap of %d, narrower than %u\n",
+					values[0], values[1], (int)values[1] - (int)values[0], values[2]);
+			break;
+		case PROBLEM_JUMP:
+			printf("the road jumps from %u %u to %u %u, too far to follow\n",
+					values[0], values[1], values[2], values[3]);
+			break;
+		case PROBLEM_START:
+			printf("the start position %u can not reach the road %u %u\n",
+					map->startpos, values[0], values[1]);
+			break;
+		case PROBLEM_READ:
+			printf("could not read the map file\n");
+			break;
+		case PROBLEM_FORMAT:
+			printf("not a text map, skipped (map_convert -t makes one)\n");
+			break;
+	}
+}
+
+unsigned long
+report_map(struct lint* lint, struct map* map)
+{
+	struct chunk* chunk;
+	struct chunk* before = NULL;
+	unsigned long long base = 1;
+	unsigned long problems = 0;
+	unsigned long printed = 0;
+	unsigned int values[4] = { 0, 0, 0, 0 };
+	int have_rows = 0;
+	size_t i;
+	size_t j;
+
+	if (map->fatal >= 0) {
+		print_problem(map, ((map->fatal == PROBLEM_READ) || (map->fatal == PROBLEM_FORMAT)) ? 0 : 1,
+				map->fatal, values);
+		return 1;
+	}
+
+	for (i = map->chunk; i < map->chunk + map->chunks; i++) {
+		chunk = &lint->chunks[i];
+
+		/* the first row is the first one after the start, or follows the
+		   last row of the chunk before */
+		if (chunk->have_rows && chunk->first_good) {
+			values[0] = chunk->first[0];
+			values[1] = chunk->first[1];
+			if (!have_rows && ((map->startpos < chunk->first[0]) || (map->startpos > chunk->first[1]))) {
+				if (!lint->limit || (printed < lint->limit)) {
+					print_problem(map, base + chunk->first_line, PROBLEM_START, values);
+					printed++;
+				}
+				problems++;
+			}
+			if (have_rows && (before != NULL) && before->last_good
+					&& !can_follow(before->last[0], before->last[1], chunk->first[0], chunk->first[1])) {
+				values[0] = before->last[0];
+				values[1] = before->last[1];
+				values[2] = chunk->first[0];
+				values[3] = chunk->first[1];
+				if (!lint->limit || (printed < lint->limit)) {
+					print_problem(map, base + chunk->first_line, PROBLEM_JUMP, values);
+					printed++;
+				}
+				problems++;
+			}
+		}
+
+		for (j = 0; j < chunk->kept; j++) {
+			if (!lint->limit || (printed < lint->limit)) {
+				print_problem(map, base + chunk->problems[j].line, chunk->problems[j].kind,
+						chunk->problems[j].values);
+				printed++;
+			}
+		}
+		problems += chunk->count;
+
+		if (chunk->have_rows) {
+			have_rows = 1;
+			before = chunk;
+		}
+		base += chunk->lines;
+	}
+
+	if (!have_rows) {
+		print_problem(map, 0, PROBLEM_NOROWS, values);
+		problems++;
+	}
+	else if (problems > printed) {
+		printf("%s: %lu more problem(s)\n", map->name, problems - printed);
+	}
+
+	return problems;
+}
+
+void
+usage(const char* name)
+{
+	printf("Usage: %s [-j threads] [-w gap] [-m problems] [-c kB] <map|directory> ...\n"\
+		   "       checks text maps and every *.map in the directories and below,\n"\
+		   "       one line per problem: map:line: what is wrong\n"\
+		   "       the header, margins within the track, the gap between them,\n"\
+		   "       whether the car can reach the road from the start position and\n"\
+		   "       follow it from row to row, one column at most\n"\
+		   "       -j threads to check on (default one per processor)\n"\
+		   "       -w the narrowest gap between the margins (default %u)\n"\
+		   "       -m problems reported per map at most (default all)\n"\
+		   "       -c kB of a map checked by one thread (default %u)\n", name, GAP_MIN, CHUNK_KB);
+}
@@ -0,0 +1,365 @@
+/**
+ * map_writer
+ *
+ * Writes a map in the background: the editors queue the rows and a
+ * thread of its own writes them, in large pieces, to a temporary file
+ * that replaces the map when it is closed.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include "map_writer.h"
+
+/* the queue at first, it grows if the disk is slow */
+#define QUEUE_INITIAL (256 * 1024)
+
+/* bytes that are worth a write call of their own */
+#define WRITE_MIN (64 * 1024)
+
+/* the longest a row waits in the queue and on the disk before fsync, in ms */
+#define SYNC_MS 1000
+
+/**
+ * Milliseconds since some point in the past.
+ */
+static long long
+now_ms(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/**
+ * Writes everything, continuing partial and interrupted writes.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int
+write_all(struct map_writer* writer, const char* data, size_t length)
+{
+	ssize_t written;
+
+	while (length > 0) {
+		written = write(writer->fd, data, length);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		writer->writes++;
+		data += written;
+		length -= written;
+	}
+	return 0;
+}
+
+/**
+ * The writer thread: waits for a full piece or the next sync, swaps the
+ * buffers and writes outside of the lock.
+ */
+static void*
+writer_main(void* argument)
+{
+	struct map_writer* writer = argument;
+	struct timespec deadline;
+	long long synced = now_ms();
+	char* data;
+	size_t length;
+	size_t capacity;
+	int dirty = 0;
+	int done;
+	int error;
+
+	pthread_mutex_lock(&writer->lock);
+	for (;;) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += SYNC_MS / 1000;
+		deadline.tv_nsec += (SYNC_MS % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		while (!writer->closing && (writer->filled < WRITE_MIN)) {
+			if (pthread_cond_timedwait(&writer->ready, &writer->lock, &deadline) == ETIMEDOUT) {
+				break;
+			}
+		}
+
+		/* the capacities go along with the buffers */
+		data = writer->fill;
+		length = writer->filled;
+		capacity = writer->capacity;
+		writer->fill = writer->drain;
+		writer->capacity = writer->drain_capacity;
+		writer->drain = data;
+		writer->drain_capacity = capacity;
+		writer->filled = 0;
+		done = writer->closing;
+		pthread_mutex_unlock(&writer->lock);
+
+		error = 0;
+		if ((length > 0) && (write_all(writer, data, length) < 0)) {
+			error = errno;
+		}
+		dirty |= (length > 0);
+		if (!error && dirty && (done || (now_ms() - synced >= SYNC_MS))) {
+			if (fdatasync(writer->fd) < 0) {
+				error = errno;
+			}
+			writer->syncs++;
+			synced = now_ms();
+			dirty = 0;
+		}
+
+		pthread_mutex_lock(&writer->lock);
+		if (error && !writer->error) {
+			writer->error = error;
+		}
+		/* nothing is queued after close */
+		if (done || writer->error) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&writer->lock);
+	return NULL;
+}
+
+int
+map_writer_open(struct map_writer* writer, const char* path)
+{
+	pthread_condattr_t attributes;
+	int error;
+
+	memset(writer, 0, sizeof(*writer));
+	writer->fd = -1;
+
+	writer->path = strdup(path);
+	writer->temporary = malloc(strlen(path) + 5);
+	writer->fill = malloc(QUEUE_INITIAL);
+	writer->drain = malloc(QUEUE_INITIAL);
+	if ((writer->path == NULL) || (writer->temporary == NULL)
+			|| (writer->fill == NULL) || (writer->drain == NULL)) {
+		error = ENOMEM;
+		goto failed;
+	}
+	writer->capacity = QUEUE_INITIAL;
+	writer->drain_capacity = QUEUE_INITIAL;
+
+	/* next to the map, so rename can put it in place */
+	strcpy(writer->temporary, path);
+	strcat(writer->temporary, ".tmp");
+	writer->fd = open(writer->temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (writer->fd < 0) {
+		error = errno;
+		goto failed;
+	}
+
+	/* the periodic wake up must not jump with the clock */
+	pthread_mutex_init(&writer->lock, NULL);
+	pthread_condattr_init(&attributes);
+	pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+	pthread_cond_init(&writer->ready, &attributes);
+	pthread_condattr_destroy(&attributes);
+
+	error = pthread_create(&writer->thread, NULL, writer_main, writer);
+	if (error) {
+		pthread_cond_destroy(&writer->ready);
+		pthread_mutex_destroy(&writer->lock);
+		close(writer->fd);
+		unlink(writer->temporary);
+		writer->fd = -1;
+		goto failed;
+	}
+	return 0;
+
+failed:
+	free(writer->path);
+	free(writer->temporary);
+	free(writer->fill);
+	free(writer->drain);
+	errno = error;
+	return -1;
+}
+
+/**
+ * Adds a line to the queue, the queue grows instead of waiting.
+ *
+ * @return 0 on success, -1 if writing failed.
+ */
+static int
+queue(struct map_writer* writer, const char* line, size_t length)
+{
+	char* grown;
+	int result = 0;
+
+	pthread_mutex_lock(&writer->lock);
+	if (writer->error) {
+		result = -1;
+	}
+	else {
+		if (writer->filled + length > writer->capacity) {
+			grown = realloc(writer->fill, 2 * writer->capacity);
+			if (grown == NULL) {
+				writer->error = ENOMEM;
+				pthread_mutex_unlock(&writer->lock);
+				return -1;
+			}
+			writer->fill = grown;
+			writer->capacity *= 2;
+		}
+		memcpy(writer->fill + writer->filled, line, length);
+		writer->filled += length;
+		if (writer->filled > writer->longest) {
+			writer->longest = writer->filled;
+		}
+		if (writer->filled >= WRITE_MIN) {
+			pthread_cond_signal(&writer->ready);
+		}
+	}
+	pthread_mutex_unlock(&writer->lock);
+	return result;
+}
+
+int
+map_writer_header(struct map_writer* writer, unsigned int size, unsigned int startpos)
+{
+	char line[32];
+
+	return queue(writer, line, snprintf(line, sizeof(line), "(%u)(%u)\n", size, startpos));
+}
+
+int
+map_writer_row(struct map_writer* writer, unsigned int leftmargin, unsigned int rightmargin)
+{
+	char line[32];
+
+	writer->rows++;
+	return queue(writer, line, snprintf(line, sizeof(line), "%u %u\n", leftmargin, rightmargin));
+}
+
+/**
+ * Stops the writer thread and releases everything but the files.
+ *
+ * @return the error writing ran into, 0 if none.
+ */
+static int
+stop(struct map_writer* writer)
+{
+	int error;
+
+	pthread_mutex_lock(&writer->lock);
+	writer->closing = 1;
+	pthread_cond_signal(&writer->ready);
+	pthread_mutex_unlock(&writer->lock);
+	pthread_join(writer->thread, NULL);
+
+	error = writer->error;
+	pthread_cond_destroy(&writer->ready);
+	pthread_mutex_destroy(&writer->lock);
+	free(writer->fill);
+	free(writer->drain);
+	writer->fill = NULL;
+	writer->drain = NULL;
+	return error;
+}
+
+int
+map_writer_close(struct map_writer* writer)
+{
+	char* slash;
+	int error;
+	int dir;
+
+	error = stop(writer);
+	if ((close(writer->fd) < 0) && !error) {
+		error = errno;
+	}
+	writer->fd = -1;
+
+	/* the map is replaced as a whole or not at all */
+	if (!error && (rename(writer->temporary, writer->path) < 0)) {
+		error = errno;
+	}
+	if (error) {
+		unlink(writer->temporary);
+	}
+	else {
+		/* and the new name is on the disk as well */
+		slash = strrchr(writer->path, '/');
+		if (slash != NULL) {
+			*slash = '\0';
+		}
+		dir = open((slash == NULL) ? "." : (slash == writer->path) ? "/" : writer->path,
+				O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (dir >= 0) {
+			fsync(dir);
+			close(dir);
+		}
+		if (slash != NULL) {
+			*slash = '/';
+		}
+	}
+
+	free(writer->path);
+	free(writer->temporary);
+	writer->path = NULL;
+	writer->temporary = NULL;
+	errno = error;
+	return error ? -1 : 0;
+}
+
+void
+map_writer_abort(struct map_writer* writer)
+{
+	if (writer->path == NULL) {
+		return;
+	}
+	stop(writer);
+	close(writer->fd);
+	writer->fd = -1;
+	unlink(writer->temporary);
+
+	free(writer->path);
+	free(writer->temporary);
+	writer->path = NULL;
+	writer->temporary = NULL;
+}
+
+void
+map_writer_report(const struct map_writer* writer, FILE* stream)
+{
+	if (writer->rows == 0) {
+		return;
+	}
+	fprintf(stream, "Map: %lu rows, %lu write calls, %lu fsync(s), at most %lu bytes queued\n",
+			writer->rows, writer->writes, writer->syncs, (unsigned long)writer->longest);
+}
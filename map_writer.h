@@ -0,0 +1,115 @@
+/**
+ * map_writer
+ *
+ * Writes a map in the background: the editors queue the rows and a
+ * thread of its own writes them, in large pieces, to a temporary file
+ * that replaces the map when it is closed.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef MAP_WRITER_H
+#define MAP_WRITER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/**
+ * A map being written.
+ */
+struct map_writer {
+	/* the map and the file it is written to until then */
+	char* path;
+	char* temporary;
+	int fd;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	/* signaled when there is enough to write, or the map is closed */
+	pthread_cond_t ready;
+
+	/* the queue: the editor adds to fill, the writer writes drain, then
+	   they are swapped, so neither waits for the other */
+	char* fill;
+	size_t filled;
+	size_t capacity;
+	char* drain;
+	size_t drain_capacity;
+
+	int closing;
+	/* errno of the first write that failed, 0 if none did */
+	int error;
+
+	/* rows queued, write and fsync calls so far */
+	unsigned long rows;
+	unsigned long writes;
+	unsigned long syncs;
+	/* the most bytes the queue held */
+	size_t longest;
+};
+
+/**
+ * Creates the temporary file next to the map and starts the writer.
+ * The map itself stays as it is until map_writer_close.
+ *
+ * @return 0 on success, -1 on error, see errno.
+ */
+int
+map_writer_open(struct map_writer* writer, const char* path);
+
+/**
+ * Queues the (size)(startpos) line.
+ *
+ * @return 0 on success, -1 if writing failed already.
+ */
+int
+map_writer_header(struct map_writer* writer, unsigned int size, unsigned int startpos);
+
+/**
+ * Queues a row, it never waits for the disk.
+ *
+ * @return 0 on success, -1 if writing failed already.
+ */
+int
+map_writer_row(struct map_writer* writer, unsigned int leftmargin, unsigned int rightmargin);
+
+/**
+ * Writes the rest, syncs the file and puts it in place of the map.
+ *
+ * @return 0 on success, -1 on error, the map is left as it was then.
+ */
+int
+map_writer_close(struct map_writer* writer);
+
+/**
+ * Stops the writer and removes the temporary file, the map is left as
+ * it was.
+ */
+void
+map_writer_abort(struct map_writer* writer);
+
+/**
+ * Prints the counters.
+ */
+void
+map_writer_report(const struct map_writer* writer, FILE* stream);
+
+#endif
@@ -0,0 +1,128 @@
+/**
+ * outbuf
+ *
+ * Collects everything a frame prints and writes it with one system call.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "outbuf.h"
+
+int
+outbuf_init(struct outbuf* out, int fd, size_t capacity)
+{
+	memset(out, 0, sizeof(*out));
+	out->fd = fd;
+	out->data = malloc(capacity);
+	if (out->data == NULL) {
+		return -1;
+	}
+	out->capacity = capacity;
+	return 0;
+}
+
+void
+outbuf_free(struct outbuf* out)
+{
+	free(out->data);
+	out->data = NULL;
+	out->capacity = 0;
+	out->length = 0;
+}
+
+void
+outbuf_put(struct outbuf* out, const char* bytes, size_t count)
+{
+	if (count > out->capacity - out->length) {
+		count = out->capacity - out->length;
+	}
+	memcpy(out->data + out->length, bytes, count);
+	out->length += count;
+}
+
+void
+outbuf_puts(struct outbuf* out, const char* string)
+{
+	outbuf_put(out, string, strlen(string));
+}
+
+void
+outbuf_line(struct outbuf* out, const char* string)
+{
+	outbuf_put(out, string, strlen(string));
+	outbuf_put(out, "\n", 1);
+}
+
+int
+outbuf_flush(struct outbuf* out)
+{
+	struct pollfd pfd;
+	size_t done = 0;
+	unsigned long syscalls = 0;
+	ssize_t result;
+
+	while (done < out->length) {
+		result = write(out->fd, out->data + done, out->length - done);
+		syscalls++;
+
+		if (result > 0) {
+			done += result;
+		}
+		else if ((result < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+			/* someone made the terminal non blocking, wait until it takes more */
+			pfd.fd = out->fd;
+			pfd.events = POLLOUT;
+			poll(&pfd, 1, -1);
+		}
+		else if ((result == 0) || (errno != EINTR)) {
+			/* nothing taken would never end, it counts as an error */
+			out->length = 0;
+			return -1;
+		}
+	}
+
+	out->frames++;
+	out->bytes += out->length;
+	out->syscalls += syscalls;
+	if (syscalls > out->max_syscalls) {
+		out->max_syscalls = syscalls;
+	}
+	out->length = 0;
+	return 0;
+}
+
+void
+outbuf_report(const struct outbuf* out, FILE* stream)
+{
+	if (out->frames == 0) {
+		return;
+	}
+	fprintf(stream, "Output: %lu frames, %lu bytes (%.1f per frame), "\
+			"%lu write calls (%.2f per frame, at most %lu)\n",
+			out->frames, out->bytes, (double)out->bytes / out->frames,
+			out->syscalls, (double)out->syscalls / out->frames, out->max_syscalls);
+}
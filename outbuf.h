@@ -0,0 +1,101 @@
+/**
+ * outbuf
+ *
+ * Collects everything a frame prints and writes it with one system call.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * The output of one frame and the counters of all frames so far.
+ */
+struct outbuf {
+	int fd;
+	char* data;
+	size_t length;
+	size_t capacity;
+
+	/* frames, bytes and write calls flushed so far */
+	unsigned long frames;
+	unsigned long bytes;
+	unsigned long syscalls;
+	/* the most write calls a single frame needed */
+	unsigned long max_syscalls;
+};
+
+/**
+ * Allocates the buffer for the frames once.
+ *
+ * @param fd Where the frames go, usually STDOUT_FILENO.
+ * @param capacity Bytes a frame may have at most.
+ *
+ * @return 0 on success, -1 without memory.
+ */
+int
+outbuf_init(struct outbuf* out, int fd, size_t capacity);
+
+/**
+ * Releases the buffer.
+ */
+void
+outbuf_free(struct outbuf* out);
+
+/**
+ * Adds bytes to the frame, whatever does not fit is cut off.
+ */
+void
+outbuf_put(struct outbuf* out, const char* bytes, size_t count);
+
+/**
+ * Adds a string to the frame.
+ */
+void
+outbuf_puts(struct outbuf* out, const char* string);
+
+/**
+ * Adds a string and a line break to the frame.
+ */
+void
+outbuf_line(struct outbuf* out, const char* string);
+
+/**
+ * Writes the frame, usually with one write call, and starts the next one.
+ *
+ * Partial writes and interrupted calls are continued until everything
+ * is out.
+ *
+ * @return 0 on success, -1 on a write error.
+ */
+int
+outbuf_flush(struct outbuf* out);
+
+/**
+ * Prints the counters.
+ */
+void
+outbuf_report(const struct outbuf* out, FILE* stream);
+
+#endif
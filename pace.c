@@ -0,0 +1,95 @@
+/**
+ * pace
+ *
+ * Frames at absolute deadlines, one period after the other on the
+ * monotonic clock, so the time a frame takes does not add up over a
+ * long track. Frames that are late catch up, if they are too late the
+ * deadlines missed are skipped.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include "pace.h"
+
+/**
+ * Moves a time on by some nanoseconds.
+ */
+static void
+add_ns(struct timespec* time, long long ns)
+{
+	ns += time->tv_nsec;
+	time->tv_sec += ns / 1000000000LL;
+	time->tv_nsec = ns % 1000000000LL;
+}
+
+void
+pace_start(struct pace* pace, unsigned int period)
+{
+	memset(pace, 0, sizeof(*pace));
+	pace->period = period * 1000LL;
+	clock_gettime(CLOCK_MONOTONIC, &pace->deadline);
+	add_ns(&pace->deadline, pace->period);
+}
+
+void
+pace_wait(struct pace* pace)
+{
+	struct timespec now;
+	long long behind;
+	long long missed;
+
+	pace->frames++;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	behind = (now.tv_sec - pace->deadline.tv_sec) * 1000000000LL
+		+ (now.tv_nsec - pace->deadline.tv_nsec);
+
+	if (behind > 0) {
+		/* the frame took longer than its period, there is nothing to wait for */
+		pace->late++;
+		if (behind > pace->behind) {
+			pace->behind = behind;
+		}
+		/* too far behind to catch up, the race goes on from now */
+		if (behind >= PACE_CATCHUP * pace->period) {
+			missed = behind / pace->period;
+			add_ns(&pace->deadline, missed * pace->period);
+			pace->skipped += missed;
+		}
+	}
+	else {
+		/* an absolute deadline does not move if a signal interrupts */
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &pace->deadline, NULL) == EINTR);
+	}
+
+	add_ns(&pace->deadline, pace->period);
+}
+
+void
+pace_report(const struct pace* pace, FILE* stream)
+{
+	if (pace->frames == 0) {
+		return;
+	}
+	fprintf(stream, "Pace: %lu frames, %lu late (at most %.3f ms behind), %lu deadline(s) skipped\n",
+			pace->frames, pace->late, pace->behind / 1e6, pace->skipped);
+}
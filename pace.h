@@ -0,0 +1,76 @@
+/**
+ * pace
+ *
+ * Frames at absolute deadlines, one period after the other on the
+ * monotonic clock, so the time a frame takes does not add up over a
+ * long track. Frames that are late catch up, if they are too late the
+ * deadlines missed are skipped.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef PACE_H
+#define PACE_H
+
+#include <stdio.h>
+#include <time.h>
+
+/* periods a frame may be behind and still catch up, the frames after
+   it come at once until they are on time again */
+#define PACE_CATCHUP 3
+
+/**
+ * The deadlines of the frames and how well they were kept.
+ */
+struct pace {
+	/* the end of the current frame */
+	struct timespec deadline;
+	long long period;
+
+	/* frames waited for, those that were past their deadline already,
+	   deadlines skipped and the most a frame was behind in ns */
+	unsigned long frames;
+	unsigned long late;
+	unsigned long skipped;
+	long long behind;
+};
+
+/**
+ * Starts the frames, the first one ends a period from now.
+ *
+ * @param period Microseconds per frame.
+ */
+void
+pace_start(struct pace* pace, unsigned int period);
+
+/**
+ * Waits for the end of the frame, if it is not over already, and sets
+ * the deadline of the next one.
+ */
+void
+pace_wait(struct pace* pace);
+
+/**
+ * Prints the counters.
+ */
+void
+pace_report(const struct pace* pace, FILE* stream);
+
+#endif
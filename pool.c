@@ -0,0 +1,212 @@
+/**
+ * pool
+ *
+ * A work stealing thread pool for batches of independent tasks.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+/**
+ * The tasks of a worker, they are numbered without gaps so the deque
+ * is the range [front, back).
+ */
+struct deque {
+	/* the deque of each worker on a cache line of its own */
+	_Alignas(64) pthread_mutex_t lock;
+	size_t front;
+	size_t back;
+};
+
+/**
+ * A thread of the pool.
+ */
+struct worker {
+	pthread_t thread;
+	unsigned int number;
+	unsigned long steals;
+	struct pool* pool;
+};
+
+/**
+ * A batch being run.
+ */
+struct pool {
+	unsigned int threads;
+	struct deque* deques;
+	struct worker* workers;
+	pool_task run;
+	void* context;
+};
+
+/**
+ * Takes the last task of the own deque.
+ *
+ * @return 1 if there was one, else 0.
+ */
+static int
+take(struct deque* deque, size_t* task)
+{
+	int found = 0;
+
+	pthread_mutex_lock(&deque->lock);
+	if (deque->front < deque->back) {
+		*task = --deque->back;
+		found = 1;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return found;
+}
+
+/**
+ * Moves the front half of a victim's tasks to the thief, the first of
+ * them is run right away.
+ *
+ * @return 1 if there was something to steal, else 0.
+ */
+static int
+steal(struct deque* victim, struct deque* thief, size_t* task)
+{
+	size_t front;
+	size_t half;
+
+	pthread_mutex_lock(&victim->lock);
+	if (victim->front >= victim->back) {
+		pthread_mutex_unlock(&victim->lock);
+		return 0;
+	}
+	half = (victim->back - victim->front + 1) / 2;
+	front = victim->front;
+	victim->front += half;
+	pthread_mutex_unlock(&victim->lock);
+
+	*task = front;
+	if (half > 1) {
+		/* the thief's own deque is empty, whoever looks at it meanwhile moves on */
+		pthread_mutex_lock(&thief->lock);
+		thief->front = front + 1;
+		thief->back = front + half;
+		pthread_mutex_unlock(&thief->lock);
+	}
+	return 1;
+}
+
+/**
+ * Runs tasks until there are none left anywhere.
+ */
+static void*
+work(void* argument)
+{
+	struct worker* worker = argument;
+	struct pool* pool = worker->pool;
+	struct deque* own = &pool->deques[worker->number];
+	unsigned int i;
+	size_t task;
+	int found;
+
+	while (1) {
+		found = take(own, &task);
+
+		/* the others, starting with the next one so not everybody robs the first */
+		for (i = 1; !found && (i < pool->threads); i++) {
+			found = steal(&pool->deques[(worker->number + i) % pool->threads], own, &task);
+			worker->steals += found;
+		}
+		if (!found) {
+			/* no task is added while running, empty everywhere means done */
+			return NULL;
+		}
+
+		pool->run(pool->context, task);
+	}
+}
+
+int
+pool_run(unsigned int threads, size_t count, pool_task run, void* context, struct pool_stats* stats)
+{
+	struct pool pool;
+	unsigned int started;
+	unsigned int i;
+	long online;
+
+	if (threads == 0) {
+		online = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (online > 0) ? online : 1;
+	}
+	/* an idle worker would only steal */
+	if ((count > 0) && (threads > count)) {
+		threads = count;
+	}
+	if (threads == 0) {
+		threads = 1;
+	}
+
+	pool.threads = threads;
+	pool.run = run;
+	pool.context = context;
+	pool.deques = calloc(threads, sizeof(*pool.deques));
+	pool.workers = calloc(threads, sizeof(*pool.workers));
+	if ((pool.deques == NULL) || (pool.workers == NULL)) {
+		free(pool.deques);
+		free(pool.workers);
+		return -1;
+	}
+
+	for (i = 0; i < threads; i++) {
+		pthread_mutex_init(&pool.deques[i].lock, NULL);
+		pool.deques[i].front = count * i / threads;
+		pool.deques[i].back = count * (i + 1) / threads;
+		pool.workers[i].number = i;
+		pool.workers[i].pool = &pool;
+	}
+
+	/* the calling thread is worker 0, the share of a thread that does not
+	   start is stolen by the others */
+	for (started = 1; started < threads; started++) {
+		if (pthread_create(&pool.workers[started].thread, NULL, work, &pool.workers[started]) != 0) {
+			break;
+		}
+	}
+	work(&pool.workers[0]);
+
+	for (i = 1; i < started; i++) {
+		pthread_join(pool.workers[i].thread, NULL);
+	}
+
+	if (stats != NULL) {
+		stats->threads = started;
+		stats->steals = 0;
+		for (i = 0; i < threads; i++) {
+			stats->steals += pool.workers[i].steals;
+		}
+	}
+
+	for (i = 0; i < threads; i++) {
+		pthread_mutex_destroy(&pool.deques[i].lock);
+	}
+	free(pool.deques);
+	free(pool.workers);
+	return 0;
+}
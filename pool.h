@@ -0,0 +1,64 @@
+/**
+ * pool
+ *
+ * A work stealing thread pool for batches of independent tasks.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/**
+ * Runs one task, tasks are numbered from 0.
+ *
+ * @param context What was given to pool_run.
+ * @param task The number of the task.
+ */
+typedef void (*pool_task)(void* context, size_t task);
+
+/**
+ * What happened while running a batch.
+ */
+struct pool_stats {
+	unsigned int threads;
+	/* tasks a worker took from another one */
+	unsigned long steals;
+};
+
+/**
+ * Runs tasks 0 to count - 1 on threads and waits until all of them
+ * are done.
+ *
+ * Each worker starts with a contiguous share of the tasks in a deque of
+ * its own and takes them from the back. A worker out of tasks steals
+ * from the front of the others, so long tasks do not leave it idle.
+ *
+ * @param threads Workers to start, 0 for one per online processor.
+ * @param stats Filled with what happened, may be NULL.
+ *
+ * @return 0 on success, -1 without memory.
+ */
+int
+pool_run(unsigned int threads, size_t count, pool_task run, void* context, struct pool_stats* stats);
+
+#endif
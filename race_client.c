@@ -0,0 +1,300 @@
+/**
+ * race_client
+ *
+ * Races on a race_server, the keys go to the server and the rows it
+ * sends back are drawn like term_racer does.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "sim.h"
+#include "outbuf.h"
+#include "render.h"
+#include "race_proto.h"
+
+/* keys read at once at most */
+#define BUFFLEN 256
+
+/* room for the players still racing after the right border */
+#define NOTE_LEN 24
+
+/**
+ * Sets the terminal attributes. (no icanon, no echo)
+ */
+void
+set_term_attr(void);
+
+/**
+ * Unsets the terminal attributes. (no icanon, no echo)
+ */
+void
+unset_term_attr(void);
+
+/**
+ * Prints how to call the client.
+ */
+void
+usage(const char* name);
+
+/**
+ * Reads from the server until the race is over.
+ *
+ * @param sock The connected socket.
+ * @param mode RENDER_LINES or RENDER_DIFF.
+ * @param end Set to the last message of the server.
+ *
+ * @return 0 if the race ended, -1 if the connection was lost or the
+ *         player quit.
+ */
+int
+race(int sock, int mode, struct race_msg* end);
+
+/* everything a frame prints, written at once */
+struct outbuf screen;
+
+/* how the rows are drawn */
+struct render view;
+
+int main(int argc, char** argv)
+{
+	const char* path = RACE_SOCKET;
+	struct sockaddr_un addr;
+	struct race_msg end;
+	int mode = RENDER_LINES;
+	int sock;
+	int result;
+	int c;
+
+	while ((c = getopt(argc, argv, "s:d")) != -1) {
+		switch (c) {
+			case 's':
+				path = optarg;
+				break;
+			case 'd':
+				mode = RENDER_DIFF;
+				break;
+			default:
+				usage(argv[0]);
+				exit(2);
+		}
+	}
+
+	if ((argc != optind) || (strlen(path) >= sizeof(addr.sun_path))) {
+		usage(argv[0]);
+		exit(2);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if ((sock == -1) || (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1)) {
+		printf("Could not connect to the race server on %s.\n", path);
+		exit(3);
+	}
+
+	printf("Setting terminal attributes.\n\n");
+	set_term_attr();
+
+	memset(&end, 0, sizeof(end));
+	result = race(sock, mode, &end);
+	render_finish(&view);
+	close(sock);
+
+	if (result < 0) {
+		printf("Oh, and I shall quit, bye!\n");
+	}
+	else if (end.state == SIM_ERROR) {
+		printf("The map broke off after row %u, the race has no result.\n", end.row);
+	}
+	else if (end.state == SIM_GOAL) {
+		printf("################################# GOAL #############################\n\n");
+		printf("Congratulations, you reached the Goal after %u rows.\n", end.row);
+	}
+	else {
+		printf("******************************** CRASH ****************************\n\n");
+		printf("Sorry, but you left the road in row %u, please try again.\n", end.row);
+	}
+	if (screen.data != NULL) {
+		outbuf_report(&screen, stdout);
+		outbuf_free(&screen);
+	}
+
+	unset_term_attr();
+	return 0;
+}
+
+int
+race(int sock, int mode, struct race_msg* end)
+{
+	char keys[BUFFLEN];
+	/* the messages, they may arrive in pieces */
+	char buffer[BUFFLEN * sizeof(struct race_msg)];
+	size_t length = 0;
+	size_t used;
+	struct race_msg msg;
+	struct pollfd fds[2];
+	ssize_t count;
+	unsigned int size = 0;
+	/* the players still racing, shown by the row where it changes */
+	unsigned int racing = 0;
+	char note[NOTE_LEN];
+	int i;
+
+	fds[0].fd = STDIN_FILENO;
+	fds[0].events = POLLIN;
+	fds[1].fd = sock;
+	fds[1].events = POLLIN;
+
+	while (1) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("poll");
+			return -1;
+		}
+
+		if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+			count = read(STDIN_FILENO, keys, sizeof(keys));
+			if (count <= 0) {
+				return -1;
+			}
+			/* the server does the steering, it only needs the keys */
+			if (send(sock, keys, count, MSG_NOSIGNAL) != count) {
+				return -1;
+			}
+			for (i = 0; i < count; i++) {
+				if (keys[i] == 'Q') {
+					return -1;
+				}
+			}
+		}
+
+		if (!(fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+			continue;
+		}
+
+		count = read(sock, buffer + length, sizeof(buffer) - length);
+		if (count <= 0) {
+			return -1;
+		}
+		length += count;
+
+		for (used = 0; length - used >= sizeof(msg); used += sizeof(msg)) {
+			memcpy(&msg, buffer + used, sizeof(msg));
+
+			if (msg.type == RACE_HELLO) {
+				size = msg.value;
+				printf("You are player %u.\n"\
+					   "CONTROLS: 'j' for left, 'k' for right.\n"\
+					   "(please make sure to have at least %u char width)\n", msg.row, size + NOTE_LEN);
+
+				putchar('|');
+				for (i = 1; i < size; i++) { putchar('-');}
+				putchar('|');
+				putchar('\n');
+
+				/* a frame is a row and maybe the crash row */
+				if ((outbuf_init(&screen, STDOUT_FILENO, 2 * (size + 3) + 64) < 0)
+						|| (render_init(&view, &screen, size, mode) < 0)) {
+					printf("Not enough memory for the output buffer.\n");
+					unset_term_attr();
+					exit(4);
+				}
+				/* the frames bypass stdio from now on */
+				fflush(stdout);
+			}
+			else if ((msg.type == RACE_ROW) && (size > 0)) {
+				if (msg.value != racing) {
+					racing = msg.value;
+					snprintf(note, sizeof(note), "  %u racing", racing);
+					view.note = note;
+				}
+				render_row(&view, msg.leftmargin, msg.rightmargin, msg.xpos);
+				view.note = NULL;
+				if (msg.state == SIM_CRASH) {
+					render_crash(&view, msg.xpos);
+				}
+				outbuf_flush(&screen);
+			}
+			else if (msg.type == RACE_END) {
+				*end = msg;
+				return 0;
+			}
+		}
+
+		memmove(buffer, buffer + used, length - used);
+		length -= used;
+	}
+}
+
+void
+usage(const char* name)
+{
+	printf("Usage: %s [-s socket] [-d]\n"\
+		   "       -s the socket of the race server (default " RACE_SOCKET ")\n"\
+		   "       -d only draw what changes, on the alternate screen\n", name);
+}
+
+void
+set_term_attr(void) {
+	struct termios aktuell;
+ 	if(tcgetattr(STDIN_FILENO, &aktuell) < 0)
+    {
+    	printf("Couldn't get terminal attributes.\n");
+    	exit(1);
+    }
+
+	aktuell.c_lflag &= ~(ICANON | ECHO);
+	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &aktuell) < 0)
+    {
+    	printf("Couldn't set terminal attributes.\n");
+    	exit(1);
+    }
+}
+
+void
+unset_term_attr(void) {
+	struct termios aktuell;
+ 	if(tcgetattr(STDIN_FILENO, &aktuell) < 0)
+    {
+    	printf("Couldn't get terminal attributes.\n");
+    	exit(1);
+    }
+
+	aktuell.c_lflag |= (ICANON | ECHO);
+	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &aktuell) < 0)
+    {
+    	printf("Couldn't set terminal attributes.\n");
+    	exit(1);
+    }
+}
@@ -0,0 +1,64 @@
+/**
+ * race_proto
+ *
+ * What race_server and race_client tell each other over the socket.
+ *
+ * The client sends the keys as they are typed ('j', 'k', 'Q'), the
+ * server answers with fixed size messages.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef RACE_PROTO_H
+#define RACE_PROTO_H
+
+#include <stdint.h>
+
+#define RACE_SOCKET "/tmp/term_racer.sock"
+
+/* message types */
+
+/* welcome, value is the size, row the player number, xpos the start */
+#define RACE_HELLO 1
+/* a row of the race as this player sees it */
+#define RACE_ROW   2
+/* the race is over for this player, state tells how */
+#define RACE_END   3
+
+/**
+ * A message from the server, it is only exchanged on one machine so
+ * the byte order is the one of the host.
+ */
+struct race_msg {
+	uint8_t type;
+	/* SIM_RUNNING, SIM_CRASH, SIM_GOAL or SIM_ERROR of this player */
+	uint8_t state;
+	uint16_t reserved;
+	uint32_t row;
+	/* RACE_HELLO: the size, RACE_ROW: the players still racing after the row */
+	uint32_t value;
+	uint16_t leftmargin;
+	uint16_t rightmargin;
+	int32_t xpos;
+};
+
+_Static_assert(sizeof(struct race_msg) == 20, "race_msg has to be packed");
+
+#endif
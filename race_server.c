@@ -0,0 +1,569 @@
+/**
+ * race_server
+ *
+ * Several players on one track, each one in a terminal of their own with
+ * race_client. The server runs the frames and sends the rows to every
+ * client over a unix domain socket.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "track.h"
+#include "sim.h"
+#include "input.h"
+#include "race_proto.h"
+
+#define FRAME_TARGET_MS 120000
+
+/* seconds between the last player joining and the first row */
+#define COUNTDOWN 3
+
+/* messages a slow client may lag behind before rows are skipped for it */
+#define BACKLOG_MSGS 64
+
+/* keys read from a client at once */
+#define BUFFLEN 256
+
+/* events handled per epoll_wait */
+#define EVENTS 64
+
+/**
+ * A connected client.
+ */
+struct player {
+	int fd;
+	unsigned int number;
+	int xpos;
+	/* SIM_RUNNING, SIM_CRASH or SIM_GOAL */
+	int state;
+	/* the row the race ended in for this player */
+	unsigned int row;
+	/* the keys since the last frame */
+	struct input_ring steering;
+	/* what could not be sent yet */
+	char out[BACKLOG_MSGS * sizeof(struct race_msg)];
+	size_t outlen;
+	/* EPOLLOUT is armed */
+	int waiting;
+	/* rows skipped because the client did not keep up */
+	unsigned long skipped;
+	/* closed once everything is sent */
+	int closing;
+};
+
+struct player** players = NULL;
+unsigned int nplayers = 0;
+int epfd;
+
+/**
+ * Prints how to call the server.
+ */
+void
+usage(const char* name);
+
+/**
+ * Queues a message for a client and sends as much as it takes without
+ * waiting. If the client lags too far behind the message is skipped.
+ *
+ * @return 0 if it was queued, -1 if it was skipped.
+ */
+int
+send_msg(struct player* player, const struct race_msg* msg);
+
+/**
+ * Sends what is queued for a client without waiting.
+ */
+void
+flush_player(struct player* player);
+
+/**
+ * Closes a client connection, the player stays in the results.
+ */
+void
+drop_player(struct player* player);
+
+/**
+ * Accepts every pending connection.
+ *
+ * @param open If new players may join.
+ */
+void
+accept_players(int listen_fd, const struct track* track, int open);
+
+/**
+ * Reads the keys of a client.
+ */
+void
+read_keys(struct player* player);
+
+/**
+ * @return true while a client is still connected.
+ */
+int
+connected(void);
+
+/**
+ * @return the milliseconds left until the deadline, at least 0.
+ */
+int
+ms_until(const struct timespec* deadline);
+
+int main(int argc, char** argv)
+{
+	FILE* map;
+	struct track track;
+	struct track_cursor cursor;
+	const char* path = RACE_SOCKET;
+	struct sockaddr_un addr;
+	struct epoll_event event;
+	struct epoll_event events[EVENTS];
+	struct itimerspec frame_timer;
+	struct race_msg msg;
+	struct input_event applied;
+	struct player* player;
+	struct timespec drain;
+	uint64_t expirations;
+	unsigned int wanted = 1;
+	unsigned int leftmargin;
+	unsigned int rightmargin;
+	unsigned int row = 0;
+	unsigned int alive = 0;
+	unsigned int i;
+	int listen_fd;
+	int tfd;
+	int started = 0;
+	int finished = 0;
+	int result;
+	int timeout;
+	int n;
+	int c;
+
+	while ((c = getopt(argc, argv, "s:p:")) != -1) {
+		switch (c) {
+			case 's':
+				path = optarg;
+				break;
+			case 'p':
+				wanted = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				usage(argv[0]);
+				exit(2);
+		}
+	}
+
+	if ((argc - optind != 1) || (wanted == 0)) {
+		usage(argv[0]);
+		exit(2);
+	}
+
+	map = fopen(argv[optind], "r");
+	if (map == NULL) {
+		printf("Could not open map file %s.\n", argv[optind]);
+		exit(3);
+	}
+	if (track_open(map, &track)) {
+		printf("The map file %s has errors.\n", argv[optind]);
+		exit(3);
+	}
+	fclose(map);
+	track_cursor_init(&cursor, &track);
+
+	/* a client that goes away must not kill the server */
+	signal(SIGPIPE, SIG_IGN);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("The socket path %s is too long.\n", path);
+		exit(2);
+	}
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if ((listen_fd == -1) || (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+			|| (listen(listen_fd, SOMAXCONN) == -1)) {
+		perror(path);
+		exit(1);
+	}
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	tfd  = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if ((epfd == -1) || (tfd == -1)) {
+		perror("epoll/timerfd");
+		exit(1);
+	}
+
+	/* the listening socket and the timer have no player */
+	event.events = EPOLLIN;
+	event.data.ptr = &listen_fd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &event);
+	event.data.ptr = &tfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &event);
+
+	printf("Waiting for %u player(s) on %s.\n", wanted, path);
+
+	while (!finished) {
+		n = epoll_wait(epfd, events, EVENTS, -1);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("epoll_wait");
+			exit(1);
+		}
+
+		for (c = 0; c < n; c++) {
+			if (events[c].data.ptr == &listen_fd) {
+				accept_players(listen_fd, &track, !started);
+
+				if (!started && (nplayers >= wanted)) {
+					/* absolute deadlines, the first row after the countdown */
+					clock_gettime(CLOCK_MONOTONIC, &frame_timer.it_value);
+					frame_timer.it_value.tv_sec += COUNTDOWN;
+					frame_timer.it_interval.tv_sec  = FRAME_TARGET_MS / 1000000;
+					frame_timer.it_interval.tv_nsec = (FRAME_TARGET_MS % 1000000) * 1000L;
+					timerfd_settime(tfd, TFD_TIMER_ABSTIME, &frame_timer, NULL);
+					started = 1;
+					alive = nplayers;
+					printf("%u player(s), starting in %d seconds.\n", nplayers, COUNTDOWN);
+				}
+				continue;
+			}
+
+			if (events[c].data.ptr == &tfd) {
+				continue;
+			}
+
+			player = events[c].data.ptr;
+			if (events[c].events & EPOLLOUT) {
+				flush_player(player);
+			}
+			if (events[c].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+				read_keys(player);
+			}
+		}
+
+		/* the frame, after the keys that came with it */
+		for (c = 0; c < n; c++) {
+			if ((events[c].data.ptr != &tfd)
+					|| (read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations))) {
+				continue;
+			}
+
+			result = track_next(&cursor, &leftmargin, &rightmargin);
+			row++;
+
+			alive = 0;
+			for (i = 0; i < nplayers; i++) {
+				player = players[i];
+				if (player->state != SIM_RUNNING) {
+					continue;
+				}
+
+				/* a bad row of the map ends the race for all, without a winner */
+				if (!result) {
+					player->state = track_failed(&cursor) ? SIM_ERROR : SIM_GOAL;
+					player->row = row - 1;
+					continue;
+				}
+
+				/* one column per row, like term_racer */
+				player->xpos += input_coalesce(&player->steering, INPUT_LATEST, &applied);
+				if ((player->fd == -1) || sim_crashed(player->xpos, leftmargin, rightmargin)) {
+					player->state = SIM_CRASH;
+					player->row = row;
+				}
+				else {
+					alive++;
+				}
+			}
+
+			/* the row to everyone in it, once it is known who is still racing */
+			for (i = 0; result && (i < nplayers); i++) {
+				player = players[i];
+				if ((player->fd == -1) || ((player->state != SIM_RUNNING) && (player->row != row))) {
+					continue;
+				}
+				memset(&msg, 0, sizeof(msg));
+				msg.type = RACE_ROW;
+				msg.state = player->state;
+				msg.row = row;
+				msg.value = alive;
+				msg.leftmargin = leftmargin;
+				msg.rightmargin = rightmargin;
+				msg.xpos = player->xpos;
+				send_msg(player, &msg);
+			}
+
+			if (alive == 0) {
+				finished = 1;
+			}
+		}
+	}
+
+	/* the results, to everyone still there */
+	for (i = 0; i < nplayers; i++) {
+		player = players[i];
+		printf("Player %u: %s at row %u, %lu row(s) skipped for a slow connection.\n",
+				player->number, (player->state == SIM_GOAL) ? "GOAL"
+				: (player->state == SIM_ERROR) ? "MAP ERROR" : "CRASH",
+				player->row, player->skipped);
+
+		if (player->fd != -1) {
+			memset(&msg, 0, sizeof(msg));
+			msg.type = RACE_END;
+			msg.state = player->state;
+			msg.row = player->row;
+			msg.xpos = player->xpos;
+			/* the end has to arrive, without room there is no point in waiting */
+			if (send_msg(player, &msg) < 0) {
+				drop_player(player);
+			}
+			else {
+				player->closing = 1;
+				if (player->outlen == 0) {
+					drop_player(player);
+				}
+			}
+		}
+	}
+
+	/* give the slow ones a second to get their results */
+	close(tfd);
+	close(listen_fd);
+	clock_gettime(CLOCK_MONOTONIC, &drain);
+	drain.tv_sec += 1;
+	while (connected() && ((timeout = ms_until(&drain)) > 0)) {
+		n = epoll_wait(epfd, events, EVENTS, timeout);
+		for (c = 0; c < n; c++) {
+			player = events[c].data.ptr;
+			if (events[c].events & EPOLLOUT) {
+				flush_player(player);
+			}
+			if (events[c].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+				read_keys(player);
+			}
+		}
+	}
+
+	for (i = 0; i < nplayers; i++) {
+		if (players[i]->fd != -1) {
+			close(players[i]->fd);
+		}
+		free(players[i]);
+	}
+	free(players);
+	close(epfd);
+	track_report(&track, stdout);
+	unlink(path);
+	track_free(&track);
+	return 0;
+}
+
+void
+accept_players(int listen_fd, const struct track* track, int open)
+{
+	struct epoll_event event;
+	struct player* player;
+	struct player** grown;
+	struct race_msg msg;
+	int fd;
+
+	while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+		if (!open) {
+			/* the race already started, nobody joins any more */
+			close(fd);
+			continue;
+		}
+
+		player = calloc(1, sizeof(*player));
+		grown = realloc(players, sizeof(*players) * (nplayers + 1));
+		if ((player == NULL) || (grown == NULL)) {
+			printf("Not enough memory for another player.\n");
+			free(player);
+			close(fd);
+			continue;
+		}
+		players = grown;
+		players[nplayers++] = player;
+
+		player->fd = fd;
+		player->number = nplayers;
+		player->xpos = track->startpos;
+		player->state = SIM_RUNNING;
+
+		event.events = EPOLLIN;
+		event.data.ptr = player;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+
+		memset(&msg, 0, sizeof(msg));
+		msg.type = RACE_HELLO;
+		msg.row = player->number;
+		msg.value = track->size;
+		msg.xpos = track->startpos;
+		send_msg(player, &msg);
+
+		printf("Player %u joined.\n", player->number);
+	}
+}
+
+void
+read_keys(struct player* player)
+{
+	char keys[BUFFLEN];
+	struct timespec stamp;
+	ssize_t count;
+
+	if (player->fd == -1) {
+		return;
+	}
+
+	count = read(player->fd, keys, sizeof(keys));
+	if ((count < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &stamp);
+	if ((count <= 0) || input_parse(keys, count, &stamp, &player->steering)) {
+		/* gone or quit, the next row counts as leaving the road */
+		drop_player(player);
+	}
+}
+
+int
+send_msg(struct player* player, const struct race_msg* msg)
+{
+	if (player->outlen + sizeof(*msg) > sizeof(player->out)) {
+		player->skipped++;
+		return -1;
+	}
+
+	memcpy(player->out + player->outlen, msg, sizeof(*msg));
+	player->outlen += sizeof(*msg);
+	flush_player(player);
+	return 0;
+}
+
+void
+flush_player(struct player* player)
+{
+	struct epoll_event event;
+	ssize_t sent;
+
+	while ((player->fd != -1) && (player->outlen > 0)) {
+		sent = send(player->fd, player->out, player->outlen, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (sent > 0) {
+			memmove(player->out, player->out + sent, player->outlen - sent);
+			player->outlen -= sent;
+		}
+		else if ((sent < 0) && (errno == EINTR)) {
+			continue;
+		}
+		else if ((sent < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+			/* the rest when the client takes more */
+			if (!player->waiting) {
+				event.events = EPOLLIN | EPOLLOUT;
+				event.data.ptr = player;
+				epoll_ctl(epfd, EPOLL_CTL_MOD, player->fd, &event);
+				player->waiting = 1;
+			}
+			return;
+		}
+		else {
+			drop_player(player);
+			return;
+		}
+	}
+
+	if (player->fd == -1) {
+		return;
+	}
+	if (player->closing) {
+		drop_player(player);
+		return;
+	}
+	if (player->waiting) {
+		event.events = EPOLLIN;
+		event.data.ptr = player;
+		epoll_ctl(epfd, EPOLL_CTL_MOD, player->fd, &event);
+		player->waiting = 0;
+	}
+}
+
+void
+drop_player(struct player* player)
+{
+	if (player->fd == -1) {
+		return;
+	}
+	epoll_ctl(epfd, EPOLL_CTL_DEL, player->fd, NULL);
+	close(player->fd);
+	player->fd = -1;
+	player->outlen = 0;
+}
+
+int
+connected(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < nplayers; i++) {
+		if (players[i]->fd != -1) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int
+ms_until(const struct timespec* deadline)
+{
+	struct timespec now;
+	long ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (deadline->tv_sec - now.tv_sec) * 1000L + (deadline->tv_nsec - now.tv_nsec) / 1000000L;
+	return (ms > 0) ? (int)ms : 0;
+}
+
+void
+usage(const char* name)
+{
+	printf("Usage: %s [-s socket] [-p players] <map>\n"\
+		   "       -s the socket to listen on (default " RACE_SOCKET ")\n"\
+		   "       -p players to wait for before the race starts (default 1)\n", name);
+}
@@ -0,0 +1,303 @@
+/**
+ * race_sim
+ *
+ * Runs a race without a terminal and without waiting for frames, the
+ * steering is read from a file with one key per row, or replays
+ * recorded by the racers are raced again to check them.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "track.h"
+#include "sim.h"
+#include "replay.h"
+
+/* chunk size to read the steering with */
+#define BUFFLEN 65536
+
+/**
+ * Prints how to call the simulator.
+ */
+void
+usage(const char* name);
+
+/**
+ * Reads the whole steering file, '-' is stdin.
+ *
+ * @param count Set to the number of moves.
+ *
+ * @return the moves, free them with free.
+ */
+signed char*
+read_moves(const char* filename, unsigned int* count);
+
+/**
+ * Races replays again and tells whether they end as they say.
+ *
+ * @param names The replay files, all of them for the map.
+ *
+ * @return the number of replays that do not.
+ */
+unsigned int
+check_replays(const struct track* track, char** names, int count, unsigned long repeat);
+
+int main(int argc, char** argv)
+{
+	FILE* map;
+	struct track track;
+	struct sim sim;
+	signed char* moves = NULL;
+	unsigned int count = 0;
+	unsigned long repeat = 1;
+	unsigned long i;
+	struct timespec start;
+	struct timespec end;
+	double seconds;
+	int replays = 0;
+	unsigned int wrong;
+	int c;
+
+	while ((c = getopt(argc, argv, "r:p")) != -1) {
+		switch (c) {
+			case 'r':
+				repeat = strtoul(optarg, NULL, 10);
+				break;
+			case 'p':
+				replays = 1;
+				break;
+			default:
+				usage(argv[0]);
+				exit(2);
+		}
+	}
+
+	if ((argc - optind < 1) || (!replays && (argc - optind > 2)) || (repeat == 0)) {
+		usage(argv[0]);
+		exit(2);
+	}
+
+	map = fopen(argv[optind], "r");
+	if (map == NULL) {
+		printf("Could not open map file %s.\n", argv[optind]);
+		exit(3);
+	}
+	if (track_load(map, &track)) {
+		printf("The map file %s has errors.\n", argv[optind]);
+		fclose(map);
+		track_free(&track);
+		exit(3);
+	}
+	fclose(map);
+
+	if (replays) {
+		wrong = check_replays(&track, argv + optind + 1, argc - optind - 1, repeat);
+		track_free(&track);
+		return wrong ? 1 : 0;
+	}
+
+	if (argc - optind == 2) {
+		moves = read_moves(argv[optind + 1], &count);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < repeat; i++) {
+		sim_init(&sim, &track);
+		sim_run(&sim, moves, count);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (sim.state == SIM_GOAL) {
+		printf("GOAL after %u rows.\n", sim.row);
+	}
+	else {
+		printf("CRASH at row %u, position %d (margins %u %u).\n",
+				sim.row, sim.xpos, sim.leftmargin, sim.rightmargin);
+	}
+
+	if (repeat > 1) {
+		seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+		printf("%lu races in %.3f s, %.0f rows per second.\n",
+				repeat, seconds, (double)sim.row * repeat / seconds);
+	}
+
+	free(moves);
+	track_free(&track);
+	return (sim.state == SIM_GOAL) ? 0 : 1;
+}
+
+signed char*
+read_moves(const char* filename, unsigned int* count)
+{
+	FILE* in;
+	char* keys = NULL;
+	char* grown;
+	size_t length = 0;
+	size_t got;
+	signed char* moves;
+
+	in = strcmp(filename, "-") ? fopen(filename, "r") : stdin;
+	if (in == NULL) {
+		printf("Could not open steering file %s.\n", filename);
+		exit(3);
+	}
+
+	do {
+		grown = realloc(keys, length + BUFFLEN);
+		if (grown == NULL) {
+			printf("Not enough memory for the steering file.\n");
+			exit(4);
+		}
+		keys = grown;
+		got = fread(keys + length, 1, BUFFLEN, in);
+		length += got;
+	} while (got == BUFFLEN);
+
+	if (ferror(in)) {
+		printf("Could not read steering file %s.\n", filename);
+		exit(3);
+	}
+	if (in != stdin) {
+		fclose(in);
+	}
+
+	/* there are never more moves than keys */
+	moves = malloc(length ? length : 1);
+	if (moves == NULL) {
+		printf("Not enough memory for the steering file.\n");
+		exit(4);
+	}
+	*count = sim_parse_moves(keys, length, moves);
+
+	free(keys);
+	return moves;
+}
+
+unsigned int
+check_replays(const struct track* track, char** names, int count, unsigned long repeat)
+{
+	FILE* in;
+	struct replay* replays;
+	/* the replays that could not be read, they are skipped */
+	char* unread;
+	struct track_cursor cursor;
+	struct sim sim;
+	struct timespec start;
+	struct timespec end;
+	unsigned long long hash = 0;
+	unsigned long long rows = 0;
+	unsigned int hashed = 0;
+	int hash_valid = 0;
+	unsigned int left;
+	unsigned int right;
+	unsigned int wrong = 0;
+	unsigned long r;
+	int i;
+
+	replays = calloc(count ? count : 1, sizeof(*replays));
+	unread = calloc(count ? count : 1, 1);
+	if ((replays == NULL) || (unread == NULL)) {
+		printf("Not enough memory for the replays.\n");
+		exit(4);
+	}
+	/* one broken replay does not stop the others */
+	for (i = 0; i < count; i++) {
+		in = strcmp(names[i], "-") ? fopen(names[i], "r") : stdin;
+		if ((in == NULL) || (replay_load(in, &replays[i]) < 0)) {
+			printf("%s: could not be read, it is no replay or a broken one.\n", names[i]);
+			unread[i] = 1;
+			wrong++;
+		}
+		if ((in != NULL) && (in != stdin)) {
+			fclose(in);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < count; i++) {
+		if (unread[i]) {
+			continue;
+		}
+		/* the map is hashed once for all replays that start in the same row */
+		if (!hash_valid || (replays[i].start != hashed)) {
+			track_cursor_init(&cursor, track);
+			for (hashed = 0; (hashed < replays[i].start) && track_next(&cursor, &left, &right); hashed++);
+			hash = replay_hash(&cursor);
+			hashed = replays[i].start;
+			hash_valid = 1;
+		}
+		if (!replay_matches(&replays[i], &cursor, hash)) {
+			printf("%s: is of another map, or starts in another row.\n", names[i]);
+			wrong++;
+			continue;
+		}
+
+		for (r = 0; r < repeat; r++) {
+			if (replay_run(&replays[i], track, &sim) < 0) {
+				break;
+			}
+		}
+		rows += (unsigned long long)sim.row * r;
+		if (r < repeat) {
+			printf("%s: moves off the track after %u rows.\n", names[i], sim.row);
+			wrong++;
+			continue;
+		}
+
+		if ((sim.state == replays[i].state) && (sim.row == replays[i].rows)) {
+			printf("%s: %s after %u rows, as recorded.\n", names[i],
+					(sim.state == SIM_GOAL) ? "GOAL" : "CRASH", sim.row);
+		}
+		else {
+			printf("%s: %s after %u rows, recorded as %s after %u rows.\n", names[i],
+					(sim.state == SIM_GOAL) ? "GOAL" : "CRASH", sim.row,
+					(replays[i].state == SIM_GOAL) ? "GOAL" : "CRASH", replays[i].rows);
+			wrong++;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	fprintf(stderr, "%d replay(s), %u wrong, %llu rows in %.3f s.\n", count, wrong, rows,
+			(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+	for (i = 0; i < count; i++) {
+		replay_free(&replays[i]);
+	}
+	free(replays);
+	free(unread);
+	return wrong;
+}
+
+void
+usage(const char* name)
+{
+	printf("Usage: %s [-r repeat] <map> [steering]\n"\
+		   "       %s [-r repeat] -p <map> <replay> ...\n"\
+		   "       steering has one key per row: 'j' left, 'k' right,\n"\
+		   "       anything else (like '.') goes straight, '-' reads stdin\n"\
+		   "       -p races the replays of term_racer and thread_racer again\n"\
+		   "          and tells whether they end as recorded\n"\
+		   "       -r runs the race repeat times and reports the speed\n", name, name);
+}
@@ -0,0 +1,175 @@
+/**
+ * race_view
+ *
+ * Watches a race of term_racer or thread_racer started with -S. The
+ * racer does not wait for it, if it falls behind it skips rows.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "sim.h"
+#include "outbuf.h"
+#include "render.h"
+#include "spectate.h"
+
+/* how often an idle viewer looks for new rows, in ms */
+#define POLL_MS 10
+
+/**
+ * Prints how to call the viewer.
+ */
+void
+usage(const char* name);
+
+/**
+ * Sleeps some milliseconds.
+ */
+void
+sleep_ms(unsigned int ms);
+
+int main(int argc, char** argv)
+{
+	struct spectate feed;
+	struct spectate_frame frame;
+	struct outbuf screen;
+	struct render view;
+	unsigned int interval = 0;
+	unsigned int i;
+	int mode = RENDER_LINES;
+	int state = SIM_RUNNING;
+	int row = 0;
+	int result;
+	int c;
+
+	while ((c = getopt(argc, argv, "di:")) != -1) {
+		switch (c) {
+			case 'd':
+				mode = RENDER_DIFF;
+				break;
+			case 'i':
+				interval = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				usage(argv[0]);
+				exit(2);
+		}
+	}
+
+	if (argc - optind != 1) {
+		usage(argv[0]);
+		exit(2);
+	}
+
+	if (spectate_attach(&feed, argv[optind]) < 0) {
+		printf("Could not watch %s: %s.\n", argv[optind], strerror(errno));
+		exit(3);
+	}
+
+	printf("Watching %s.\n", argv[optind]);
+	putchar('|');
+	for (i = 1; i < feed.ring->size; i++) { putchar('-');}
+	putchar('|');
+	putchar('\n');
+
+	/* a frame is a row and maybe the crash row */
+	if ((outbuf_init(&screen, STDOUT_FILENO, 2 * (feed.ring->size + 3) + 64) < 0)
+			|| (render_init(&view, &screen, feed.ring->size, mode) < 0)) {
+		printf("Not enough memory for the output buffer.\n");
+		exit(4);
+	}
+	/* the frames bypass stdio from now on */
+	fflush(stdout);
+
+	while (state == SIM_RUNNING) {
+		/* with an interval only the newest row of each one is drawn */
+		result = spectate_read(&feed, &frame, interval > 0);
+		if (result < 0) {
+			break;
+		}
+		if (result == 0) {
+			sleep_ms(interval ? interval : POLL_MS);
+			continue;
+		}
+
+		row = frame.row;
+		state = frame.state;
+		if ((state == SIM_GOAL) || (state == SIM_ERROR)) {
+			break;
+		}
+		render_row(&view, frame.leftmargin, frame.rightmargin, frame.xpos);
+		if (state == SIM_CRASH) {
+			render_crash(&view, frame.xpos);
+		}
+		outbuf_flush(&screen);
+
+		if (interval) {
+			sleep_ms(interval);
+		}
+	}
+	render_finish(&view);
+
+	if (state == SIM_GOAL) {
+		printf("The racer reached the goal after %d rows.\n", row);
+	}
+	else if (state == SIM_CRASH) {
+		printf("The racer left the road in row %d.\n", row);
+	}
+	else if (state == SIM_ERROR) {
+		printf("The map broke off after row %d, the race has no result.\n", row);
+	}
+	else {
+		printf("The racer is gone after row %d.\n", row);
+	}
+	printf("%lu row(s) skipped.\n", feed.skipped);
+	outbuf_report(&screen, stdout);
+
+	outbuf_free(&screen);
+	spectate_close(&feed);
+	return 0;
+}
+
+void
+sleep_ms(unsigned int ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	while ((nanosleep(&ts, &ts) < 0) && (errno == EINTR));
+}
+
+void
+usage(const char* name)
+{
+	printf("Usage: %s [-d] [-i interval] <name>\n"\
+		   "       name is the one given to the racer with -S\n"\
+		   "       -d only draw what changes, on the alternate screen\n"\
+		   "       -i ms between drawn rows, the rows in between are skipped\n"\
+		   "          (default: every row as soon as it is there)\n", name);
+}
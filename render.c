@@ -0,0 +1,212 @@
+/**
+ * render
+ *
+ * Draws the rows of the racers, either line by line or by only sending
+ * the cells that change to a terminal.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "render.h"
+
+#define ESC "\033"
+
+/* cells on a row: both borders, both margins, the ghost and the car */
+#define CELLS 6
+
+/* the screen to restore at exit, if the differential mode is active */
+static struct render* active = NULL;
+
+/**
+ * Restores the screen if the game exits anywhere.
+ */
+static void
+render_atexit(void)
+{
+	if (active != NULL) {
+		render_finish(active);
+	}
+}
+
+/**
+ * Moves the cursor right on a blank row, with spaces if that is shorter.
+ */
+static void
+forward(struct outbuf* out, unsigned int columns)
+{
+	char sequence[16];
+
+	if (columns == 0) {
+		return;
+	}
+	if (columns <= 4) {
+		outbuf_put(out, "    ", columns);
+		return;
+	}
+	snprintf(sequence, sizeof(sequence), ESC "[%uC", columns);
+	outbuf_puts(out, sequence);
+}
+
+int
+render_init(struct render* render, struct outbuf* out, unsigned int size, int mode)
+{
+	struct winsize ws;
+	const char* term = getenv("TERM");
+	char sequence[32];
+
+	memset(render, 0, sizeof(*render));
+	render->out = out;
+	render->size = size;
+	render->mode = RENDER_LINES;
+	render->ghost = -1;
+
+	render->line = malloc(size + 2);
+	if (render->line == NULL) {
+		return -1;
+	}
+	sprintf(render->line, "|%*c", size, '|');
+
+	if (mode != RENDER_DIFF) {
+		return render->mode;
+	}
+
+	if (!isatty(out->fd) || (term == NULL) || !strcmp(term, "dumb")
+			|| (ioctl(out->fd, TIOCGWINSZ, &ws) < 0) || (ws.ws_row < 2)) {
+		printf("The output is no terminal for the differential mode, drawing lines.\n");
+		return render->mode;
+	}
+	if (ws.ws_col < size + 1) {
+		printf("The terminal is narrower than %u, drawing lines.\n", size + 1);
+		return render->mode;
+	}
+
+	render->mode = RENDER_DIFF;
+	active = render;
+	atexit(render_atexit);
+
+	/* alternate screen, cleared, the whole of it scrolls, cursor at the bottom */
+	outbuf_puts(out, ESC "[?1049h" ESC "[2J" ESC "[?25l");
+	snprintf(sequence, sizeof(sequence), ESC "[1;%ur" ESC "[%u;1H", ws.ws_row, ws.ws_row);
+	outbuf_puts(out, sequence);
+	outbuf_flush(out);
+
+	return render->mode;
+}
+
+void
+render_finish(struct render* render)
+{
+	if (render->mode == RENDER_DIFF) {
+		outbuf_puts(render->out, ESC "[r" ESC "[?25h" ESC "[?1049l");
+		outbuf_flush(render->out);
+		render->mode = RENDER_LINES;
+	}
+	if (active == render) {
+		active = NULL;
+	}
+	free(render->line);
+	render->line = NULL;
+}
+
+void
+render_row(struct render* render, unsigned int leftmargin, unsigned int rightmargin, int xpos)
+{
+	unsigned int columns[CELLS];
+	char cells[CELLS];
+	unsigned int column = 0;
+	unsigned int count = 0;
+	unsigned int i;
+	char* line = render->line;
+
+	/* the plain row, the line mode prints it, others may want to read it */
+	if ((render->ghost >= 0) && (render->ghost <= (int)render->size)) {
+		line[render->ghost] = 'o';
+	}
+	line[leftmargin] = '#';
+	line[rightmargin] = '#';
+	line[xpos] = 'V';
+
+	if (render->mode == RENDER_LINES) {
+		if (render->note != NULL) {
+			outbuf_puts(render->out, line);
+			outbuf_line(render->out, render->note);
+		}
+		else {
+			outbuf_line(render->out, line);
+		}
+	}
+	else {
+		/* the line break scrolls, the new row is blank but for these */
+		outbuf_put(render->out, "\n", 1);
+		for (i = 0; i <= render->size; i++) {
+			if (line[i] != ' ') {
+				/* the row has at most CELLS of them, see above */
+				columns[count] = i;
+				cells[count++] = line[i];
+			}
+		}
+		for (i = 0; i < count; i++) {
+			forward(render->out, columns[i] - column);
+			outbuf_put(render->out, &cells[i], 1);
+			column = columns[i] + 1;
+		}
+		/* right after the border, which is the last cell */
+		if (render->note != NULL) {
+			outbuf_puts(render->out, render->note);
+		}
+	}
+
+	line[xpos] = ' ';
+	if ((render->ghost >= 0) && (render->ghost <= (int)render->size)) {
+		line[render->ghost] = ' ';
+	}
+	line[leftmargin] = ' ';
+	line[rightmargin] = ' ';
+	line[0] = '|';
+	line[render->size] = '|';
+}
+
+void
+render_crash(struct render* render, int xpos)
+{
+	char sequence[16];
+
+	if (render->mode == RENDER_LINES) {
+		render->line[xpos] = 'X';
+		outbuf_line(render->out, render->line);
+		render->line[xpos] = (xpos == 0) || (xpos == (int)render->size) ? '|' : ' ';
+	}
+	else {
+		/* just the cell of the car on the row that is already there, the
+		   cursor moves over it, spaces would blank its border */
+		outbuf_put(render->out, "\r", 1);
+		if (xpos > 0) {
+			snprintf(sequence, sizeof(sequence), ESC "[%dC", xpos);
+			outbuf_puts(render->out, sequence);
+		}
+		outbuf_put(render->out, "X", 1);
+	}
+}
@@ -0,0 +1,86 @@
+/**
+ * render
+ *
+ * Draws the rows of the racers, either line by line or by only sending
+ * the cells that change to a terminal.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "outbuf.h"
+
+/* how the rows are drawn */
+#define RENDER_LINES 0
+#define RENDER_DIFF  1
+
+/**
+ * The state of the screen.
+ */
+struct render {
+	struct outbuf* out;
+	/* RENDER_LINES or RENDER_DIFF */
+	int mode;
+	/* Trackwidth in characters. */
+	unsigned int size;
+	/* the last row as plain text, in every mode */
+	char* line;
+	/* where a ghost of another race is drawn in the next row, -1 for none */
+	int ghost;
+	/* text after the right border of the next row, NULL for none */
+	const char* note;
+};
+
+/**
+ * Prepares drawing, the differential mode falls back to lines if the
+ * output is no terminal able to do it.
+ *
+ * @param out Where the frames are collected.
+ * @param size Trackwidth in characters.
+ * @param mode The mode wanted, RENDER_LINES or RENDER_DIFF.
+ *
+ * @return the mode used, -1 without memory.
+ */
+int
+render_init(struct render* render, struct outbuf* out, unsigned int size, int mode);
+
+/**
+ * Leaves the terminal as it was before, called at exit as well.
+ */
+void
+render_finish(struct render* render);
+
+/**
+ * Draws a row of the track with the car/ship/whatever on it, and the
+ * ghost and the note if there are any. The car hides the ghost, the
+ * margins as well.
+ */
+void
+render_row(struct render* render, unsigned int leftmargin, unsigned int rightmargin, int xpos);
+
+/**
+ * Marks where the car/ship/whatever left the track.
+ */
+void
+render_crash(struct render* render, int xpos);
+
+#endif
@@ -0,0 +1,495 @@
+/**
+ * replay
+ *
+ * A race as it was steered: the map it was raced on, the frame period
+ * and the steering of every row, to race it again exactly.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "replay.h"
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME  1099511628211ULL
+
+/* the longest varint of an unsigned int */
+#define VARINT_MAX 5
+
+static void
+put_le(unsigned char* p, unsigned long long v, unsigned int bytes)
+{
+	unsigned int i;
+
+	for (i = 0; i < bytes; i++) {
+		p[i] = (v >> (8 * i)) & 0xff;
+	}
+}
+
+static unsigned long long
+get_le(const unsigned char* p, unsigned int bytes)
+{
+	unsigned long long v = 0;
+	unsigned int i;
+
+	for (i = 0; i < bytes; i++) {
+		v |= (unsigned long long)p[i] << (8 * i);
+	}
+	return v;
+}
+
+/**
+ * Hashes a number as 4 bytes, low byte first.
+ */
+static unsigned long long
+hash_le32(unsigned long long hash, unsigned int v)
+{
+	unsigned int i;
+
+	for (i = 0; i < 4; i++) {
+		hash ^= (v >> (8 * i)) & 0xff;
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+/**
+ * Appends a varint.
+ *
+ * @return the bytes written, at most VARINT_MAX.
+ */
+static size_t
+put_varint(unsigned char* p, unsigned int v)
+{
+	size_t n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+	return n;
+}
+
+/**
+ * Reads a varint, it must end before the end of the data.
+ *
+ * @return 0 on success, -1 if it does not.
+ */
+static int
+get_varint(const unsigned char* data, size_t length, size_t* pos, unsigned int* v)
+{
+	unsigned int shift = 0;
+
+	*v = 0;
+	while ((*pos < length) && (shift < 7 * VARINT_MAX)) {
+		*v |= (unsigned int)(data[*pos] & 0x7f) << shift;
+		if (!(data[(*pos)++] & 0x80)) {
+			return 0;
+		}
+		shift += 7;
+	}
+	return -1;
+}
+
+/**
+ * Reads the next event for playback, the row is UINT_MAX after the last.
+ *
+ * @return 0 on success, -1 if the event is broken.
+ */
+static int
+advance(struct replay* replay)
+{
+	unsigned int delta;
+	unsigned int zigzag;
+	int first = (replay->pos == 0);
+
+	if (replay->pos >= replay->length) {
+		replay->next = UINT_MAX;
+		replay->dx = 0;
+		return 0;
+	}
+	if ((get_varint(replay->data, replay->length, &replay->pos, &delta) < 0)
+			|| (get_varint(replay->data, replay->length, &replay->pos, &zigzag) < 0)
+			|| (zigzag == 0) || (!first && (delta == 0))
+			|| (delta > UINT_MAX - 1 - replay->last)) {
+		return -1;
+	}
+	replay->last += delta;
+	replay->next = replay->last;
+	replay->dx = (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+	return 0;
+}
+
+unsigned long long
+replay_hash(const struct track_cursor* cursor)
+{
+	struct track_cursor copy = *cursor;
+	unsigned long long hash = FNV_OFFSET;
+	unsigned int left;
+	unsigned int right;
+
+	hash = hash_le32(hash, cursor->track->size);
+	while (track_next(&copy, &left, &right)) {
+		hash = hash_le32(hash, left);
+		hash = hash_le32(hash, right);
+	}
+	return hash;
+}
+
+int
+replay_matches(const struct replay* replay, const struct track_cursor* cursor,
+		unsigned long long hash)
+{
+	const struct track* track = cursor->track;
+
+	return (hash == replay->hash) && (track->size == replay->size)
+		&& (replay->rows <= track->rows - cursor->row);
+}
+
+void
+replay_start(struct replay* replay, unsigned long long hash, unsigned int size,
+		unsigned int start, int xpos, unsigned int period)
+{
+	memset(replay, 0, sizeof(*replay));
+	replay->hash = hash;
+	replay->size = size;
+	replay->start = start;
+	replay->xpos = xpos;
+	replay->period = period;
+	replay->state = SIM_RUNNING;
+}
+
+int
+replay_step(struct replay* replay, unsigned int row, int dx)
+{
+	unsigned char* grown;
+
+	if ((dx == 0) || replay->failed) {
+		return replay->failed ? -1 : 0;
+	}
+
+	if (replay->length + 2 * VARINT_MAX > replay->capacity) {
+		grown = realloc(replay->data, replay->capacity ? 2 * replay->capacity : 4096);
+		if (grown == NULL) {
+			replay->failed = 1;
+			return -1;
+		}
+		replay->data = grown;
+		replay->capacity = replay->capacity ? 2 * replay->capacity : 4096;
+	}
+
+	replay->length += put_varint(replay->data + replay->length, row - replay->last);
+	replay->length += put_varint(replay->data + replay->length,
+			((unsigned int)dx << 1) ^ (unsigned int)(dx >> (sizeof(int) * CHAR_BIT - 1)));
+	replay->last = row;
+	replay->events++;
+	return 0;
+}
+
+void
+replay_finish(struct replay* replay, unsigned int rows, int state)
+{
+	replay->rows = rows;
+	replay->state = state;
+}
+
+int
+replay_save(const struct replay* replay, FILE* out)
+{
+	unsigned char header[REPLAY_HEADER_SIZE];
+
+	if (replay->failed || (replay->state == SIM_RUNNING)) {
+		return -1;
+	}
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, REPLAY_MAGIC, 4);
+	put_le(header + 4, REPLAY_VERSION, 4);
+	put_le(header + 8, replay->hash, 8);
+	put_le(header + 16, replay->size, 4);
+	put_le(header + 20, replay->start, 4);
+	put_le(header + 24, (unsigned int)replay->xpos, 4);
+	put_le(header + 28, replay->period, 4);
+	put_le(header + 32, replay->rows, 4);
+	put_le(header + 36, replay->state, 4);
+	put_le(header + 40, replay->events, 4);
+	put_le(header + 44, replay->length, 4);
+
+	if ((fwrite(header, 1, sizeof(header), out) != sizeof(header))
+			|| (fwrite(replay->data, 1, replay->length, out) != replay->length)) {
+		return -1;
+	}
+	return 0;
+}
+
+int
+replay_load(FILE* in, struct replay* replay)
+{
+	unsigned char header[REPLAY_HEADER_SIZE];
+	unsigned int i;
+	int xpos;
+
+	memset(replay, 0, sizeof(*replay));
+
+	if ((fread(header, 1, sizeof(header), in) != sizeof(header))
+			|| memcmp(header, REPLAY_MAGIC, 4)
+			|| (get_le(header + 4, 4) != REPLAY_VERSION)) {
+		return -1;
+	}
+	replay->hash = get_le(header + 8, 8);
+	replay->size = get_le(header + 16, 4);
+	replay->start = get_le(header + 20, 4);
+	replay->xpos = (int)get_le(header + 24, 4);
+	replay->period = get_le(header + 28, 4);
+	replay->rows = get_le(header + 32, 4);
+	replay->state = get_le(header + 36, 4);
+	replay->events = get_le(header + 40, 4);
+	replay->length = get_le(header + 44, 4);
+	replay->capacity = replay->length;
+
+	if (((replay->state != SIM_CRASH) && (replay->state != SIM_GOAL))
+			|| (replay->size > INT_MAX) || (replay->xpos <= 0)
+			|| (replay->xpos >= (int)replay->size)) {
+		return -1;
+	}
+
+	replay->data = malloc(replay->length ? replay->length : 1);
+	if ((replay->data == NULL)
+			|| (fread(replay->data, 1, replay->length, in) != replay->length)) {
+		replay_free(replay);
+		return -1;
+	}
+
+	/* every event is checked once, playback trusts them */
+	xpos = replay->xpos;
+	for (i = 0; i < replay->events; i++) {
+		if ((advance(replay) < 0) || (replay->next >= replay->rows)
+				|| (replay->dx < -xpos) || (replay->dx > (int)replay->size - xpos)) {
+			replay_free(replay);
+			return -1;
+		}
+		xpos += replay->dx;
+	}
+	if (replay->pos != replay->length) {
+		replay_free(replay);
+		return -1;
+	}
+
+	replay_rewind(replay);
+	return 0;
+}
+
+int
+replay_open(const char* name, struct replay* replay)
+{
+	FILE* in;
+	int result;
+
+	memset(replay, 0, sizeof(*replay));
+	in = fopen(name, "r");
+	if (in == NULL) {
+		return -1;
+	}
+	result = replay_load(in, replay);
+	fclose(in);
+	return result;
+}
+
+void
+replay_rewind(struct replay* replay)
+{
+	replay->pos = 0;
+	replay->last = 0;
+	advance(replay);
+}
+
+int
+replay_next(struct replay* replay, unsigned int row)
+{
+	int dx;
+
+	if (row != replay->next) {
+		return 0;
+	}
+	dx = replay->dx;
+	advance(replay);
+	return dx;
+}
+
+int
+replay_run(struct replay* replay, const struct track* track, struct sim* sim)
+{
+	unsigned int left;
+	unsigned int right;
+	unsigned int i;
+	int dx;
+
+	sim_init(sim, track);
+	for (i = 0; i < replay->start; i++) {
+		if (!track_next(&sim->cursor, &left, &right)) {
+			return -1;
+		}
+	}
+	sim->xpos = replay->xpos;
+
+	replay_rewind(replay);
+	while (sim->state == SIM_RUNNING) {
+		dx = replay_next(replay, sim->row);
+		if ((sim->xpos + dx < 0) || (sim->xpos + dx > (int)track->size)) {
+			return -1;
+		}
+		sim_step(sim, dx);
+	}
+	return sim->state;
+}
+
+int*
+replay_positions(struct replay* replay)
+{
+	int* positions;
+	int xpos = replay->xpos;
+	unsigned int row;
+
+	positions = malloc(sizeof(*positions) * (replay->rows ? replay->rows : 1));
+	if (positions == NULL) {
+		return NULL;
+	}
+
+	replay_rewind(replay);
+	for (row = 0; row < replay->rows; row++) {
+		xpos += replay_next(replay, row);
+		positions[row] = xpos;
+	}
+	replay_rewind(replay);
+	return positions;
+}
+
+void
+replay_free(struct replay* replay)
+{
+	free(replay->data);
+	replay->data = NULL;
+	replay->length = 0;
+	replay->capacity = 0;
+}
+
+int
+replay_racer_open(struct replay_racer* racer, unsigned int* start, unsigned int* period)
+{
+	/* a replay starts where the race it recorded started */
+	if (racer->play_name != NULL) {
+		if (replay_open(racer->play_name, &racer->playback) < 0) {
+			printf("Could not read the replay %s.\n", racer->play_name);
+			return 3;
+		}
+		*start = racer->playback.start;
+		*period = racer->playback.period;
+		racer->playing = 1;
+	}
+	/* and the ghost races along from there */
+	if (racer->ghost_name != NULL) {
+		if (replay_open(racer->ghost_name, &racer->ghost) < 0) {
+			printf("Could not read the replay %s.\n", racer->ghost_name);
+			return 3;
+		}
+		if (racer->playing && (racer->ghost.start != *start)) {
+			printf("The ghost %s starts in another row than the replay.\n", racer->ghost_name);
+			return 3;
+		}
+		*start = racer->ghost.start;
+	}
+	return 0;
+}
+
+int
+replay_racer_start(struct replay_racer* racer, const struct track_cursor* cursor,
+		int* xpos, unsigned int period)
+{
+	const struct track* track = cursor->track;
+	unsigned long long hash = 0;
+
+	/* a replay belongs to the rows from the start on, as a whole */
+	if ((racer->play_name != NULL) || (racer->record_name != NULL) || (racer->ghost_name != NULL)) {
+		if (track->format == TRACK_STREAM) {
+			printf("A replay needs the whole map, not one from a pipe.\n");
+			return 3;
+		}
+		hash = replay_hash(cursor);
+	}
+	if (racer->playing) {
+		if (!replay_matches(&racer->playback, cursor, hash)) {
+			printf("The replay %s is of another map.\n", racer->play_name);
+			return 3;
+		}
+		*xpos = racer->playback.xpos;
+	}
+	if (racer->ghost_name != NULL) {
+		if (!replay_matches(&racer->ghost, cursor, hash)) {
+			printf("The replay %s is of another map.\n", racer->ghost_name);
+			return 3;
+		}
+		racer->ghost_xpos = replay_positions(&racer->ghost);
+		if (racer->ghost_xpos == NULL) {
+			printf("Not enough memory for the ghost.\n");
+			return 4;
+		}
+		racer->ghost_rows = racer->ghost.rows;
+		replay_free(&racer->ghost);
+	}
+	if (racer->record_name != NULL) {
+		racer->record_file = fopen(racer->record_name, "w");
+		if (racer->record_file == NULL) {
+			printf("Could not open the replay file %s.\n", racer->record_name);
+			return 3;
+		}
+		replay_start(&racer->recording, hash, track->size, track->first + cursor->row,
+				*xpos, period);
+	}
+	return 0;
+}
+
+void
+replay_racer_close(struct replay_racer* racer)
+{
+	int result;
+
+	if (racer->record_file != NULL) {
+		result = replay_save(&racer->recording, racer->record_file);
+		if ((fclose(racer->record_file) != 0) || (result < 0)) {
+			printf("There was an error writing the replay %s.\n", racer->record_name);
+			remove(racer->record_name);
+		}
+		else {
+			printf("Replay: %u rows, %u moves in %lu bytes, saved to %s.\n", racer->recording.rows,
+					racer->recording.events, (unsigned long)(REPLAY_HEADER_SIZE + racer->recording.length),
+					racer->record_name);
+		}
+		racer->record_file = NULL;
+		replay_free(&racer->recording);
+	}
+	replay_free(&racer->playback);
+	replay_free(&racer->ghost);
+	free(racer->ghost_xpos);
+	racer->ghost_xpos = NULL;
+}
@@ -0,0 +1,270 @@
+/**
+ * replay
+ *
+ * A race as it was steered: the map it was raced on, the frame period
+ * and the steering of every row, to race it again exactly.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "track.h"
+#include "sim.h"
+
+/*
+ * The replay file, all numbers little endian:
+ *
+ *   magic "TRPL", version (4 bytes), the hash of the map (8 bytes), the
+ *   width of the track, the start row, the start position, the frame
+ *   period in microseconds, the rows raced, the outcome (SIM_CRASH or
+ *   SIM_GOAL), the number of events and their length in bytes (4 bytes
+ *   each), followed by the events.
+ *
+ * An event is a row that moved the car: the rows since the last event
+ * (since the start for the first one) and how far it moved, zigzag
+ * encoded (0, -1, 1, -2, ... as 0, 1, 2, 3, ...), both as varints of 7
+ * bits per byte, low bits first, the high bit set on all but the last.
+ *
+ * The car starts on the track, 0 < xpos < size, and no move takes it
+ * outside the width of it, 0 to size, that is where both racers keep it.
+ * No event is in or after the row the race ended in.
+ */
+#define REPLAY_MAGIC       "TRPL"
+#define REPLAY_VERSION     1
+#define REPLAY_HEADER_SIZE 48
+
+/**
+ * A race being recorded or played back.
+ */
+struct replay {
+	/* the rows raced, from the start row on, see replay_hash */
+	unsigned long long hash;
+	unsigned int size;
+	/* the row the race starts in, counted from 0, and where the car is */
+	unsigned int start;
+	int xpos;
+	/* microseconds per row */
+	unsigned int period;
+
+	/* how the race ended, once it did */
+	unsigned int rows;
+	int state;
+
+	/* the encoded events */
+	unsigned char* data;
+	size_t length;
+	size_t capacity;
+	unsigned int events;
+	/* the row of the last event recorded, or played back */
+	unsigned int last;
+	/* set if an event could not be recorded */
+	int failed;
+
+	/* the event played back next, and its row and move */
+	size_t pos;
+	unsigned int next;
+	int dx;
+};
+
+/**
+ * The replays of a racer: the race played back instead of the keys, the
+ * ghost that races along and the race recorded.
+ */
+struct replay_racer {
+	/* the files asked for, NULL for none */
+	const char* play_name;
+	const char* ghost_name;
+	const char* record_name;
+
+	/* the race played back, if playing */
+	struct replay playback;
+	int playing;
+
+	/* the ghost until replay_racer_start, then the car of it in every
+	   row from the start on */
+	struct replay ghost;
+	int* ghost_xpos;
+	unsigned int ghost_rows;
+
+	/* the race recorded, if there is a file for it */
+	struct replay recording;
+	FILE* record_file;
+};
+
+/**
+ * Hashes the rest of a track, from a cursor on, with FNV-1a over the
+ * width and the margins of every row as the racers see them. The format
+ * the map is stored in does not matter.
+ *
+ * @param cursor It is not moved, the rows are read from a copy. It must
+ *        not be on a streamed track.
+ */
+unsigned long long
+replay_hash(const struct track_cursor* cursor);
+
+/**
+ * Whether a replay was recorded on the rest of a track, from a cursor on:
+ * the hash and the width match and it raced no more rows than there are.
+ *
+ * @param hash replay_hash of the cursor.
+ */
+int
+replay_matches(const struct replay* replay, const struct track_cursor* cursor,
+		unsigned long long hash);
+
+/**
+ * Starts recording.
+ *
+ * @param hash The hash of the rows from the start row on.
+ * @param start The start row, counted from 0.
+ */
+void
+replay_start(struct replay* replay, unsigned long long hash, unsigned int size,
+		unsigned int start, int xpos, unsigned int period);
+
+/**
+ * Records the move of a row, rows that go straight take no room.
+ *
+ * @param row The rows raced before this one.
+ *
+ * @return 0 on success, -1 without memory, the replay is failed then.
+ */
+int
+replay_step(struct replay* replay, unsigned int row, int dx);
+
+/**
+ * Records how the race ended.
+ *
+ * @param rows The rows raced, the crash row included.
+ * @param state SIM_CRASH or SIM_GOAL.
+ */
+void
+replay_finish(struct replay* replay, unsigned int rows, int state);
+
+/**
+ * Writes a finished replay.
+ *
+ * @return 0 on success, -1 on error or if it failed.
+ */
+int
+replay_save(const struct replay* replay, FILE* out);
+
+/**
+ * Reads a replay and rewinds it for playback. The moves are checked
+ * against the rules above, playback trusts them.
+ *
+ * @return 0 on success, -1 if it is no replay or a broken one.
+ */
+int
+replay_load(FILE* in, struct replay* replay);
+
+/**
+ * Reads a replay from a file, see replay_load.
+ *
+ * @return 0 on success, -1 if it can not be read or is no replay.
+ */
+int
+replay_open(const char* name, struct replay* replay);
+
+/**
+ * Goes back to the first event.
+ */
+void
+replay_rewind(struct replay* replay);
+
+/**
+ * The move of a row played back, the rows must be asked for in order.
+ *
+ * @param row The rows raced before this one.
+ */
+int
+replay_next(struct replay* replay, unsigned int row);
+
+/**
+ * Races a replay again on a track, at full speed and without a screen.
+ *
+ * @param sim Set to the end of the race, sim->row is the rows raced
+ *        from the start row on.
+ *
+ * @return the state the race ended in, -1 if the track has no start row
+ *         or a move takes the car off the width of the track.
+ */
+int
+replay_run(struct replay* replay, const struct track* track, struct sim* sim);
+
+/**
+ * Where the car is in every row of a replay, after the move of the row.
+ * It follows from the moves alone, the track is not needed.
+ *
+ * @return replay->rows positions, free them with free, NULL without
+ *         memory.
+ */
+int*
+replay_positions(struct replay* replay);
+
+/**
+ * Releases the events.
+ */
+void
+replay_free(struct replay* replay);
+
+/**
+ * Reads the replay to play back and the ghost, if the racer asks for
+ * them, before the map is read. A race played back starts in the row of
+ * the replay and keeps its period, the ghost has to start there too.
+ *
+ * @param racer Zeroed but for the names.
+ * @param start Set to the start row of the replays, if there are any.
+ * @param period Set to the period of the replay played back, if any.
+ *
+ * @return 0 on success, else what the racer exits with, the error is
+ *         printed.
+ */
+int
+replay_racer_open(struct replay_racer* racer, unsigned int* start, unsigned int* period);
+
+/**
+ * Checks the replays against the rows from the start on and opens the
+ * file to record to, once the map is read. The positions of the ghost
+ * are worked out here, drawing it costs nothing then.
+ *
+ * @param cursor On the start row.
+ * @param xpos Where the car starts, set to where the replay played
+ *        back starts.
+ *
+ * @return 0 on success, else what the racer exits with, the error is
+ *         printed.
+ */
+int
+replay_racer_start(struct replay_racer* racer, const struct track_cursor* cursor,
+		int* xpos, unsigned int period);
+
+/**
+ * Saves the race recorded, if there is one, and releases the replays.
+ */
+void
+replay_racer_close(struct replay_racer* racer);
+
+#endif
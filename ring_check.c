@@ -0,0 +1,127 @@
+/**
+ * ring_check
+ *
+ * Pushes events through the input ring from one thread and pops them in
+ * another, as the input thread and the game loop do, and checks that
+ * every event came out whole and in order or was counted as dropped.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "input.h"
+
+/* events the producer pushes */
+#define EVENTS 20000000UL
+
+/* the consumer pauses every that many events, so the ring runs full */
+#define PAUSE_EVERY 10000UL
+
+/* the producer waits for room, but for a burst of events out of every
+   period, those are dropped if the ring is full */
+#define BURST_PERIOD 65536UL
+#define BURST 4096UL
+
+struct input_ring ring;
+
+/* set by the producer when it pushed the last event */
+atomic_int done;
+
+/**
+ * Pushes the events, numbered from 1, the rest of an event is made up
+ * from its number so that a torn one shows. Most of them wait for room
+ * in the ring, those of a burst are pushed at once whether it is full
+ * or not.
+ */
+void*
+produce(void* unused);
+
+int main(int argc, char** argv)
+{
+	pthread_t producer;
+	struct input_event event;
+	unsigned long popped = 0;
+	unsigned long last = 0;
+	unsigned long torn = 0;
+	unsigned long disorder = 0;
+	unsigned long lost;
+	int finished;
+	int i;
+
+	if (pthread_create(&producer, NULL, &produce, NULL)) {
+		printf("Could not start the producer.\n");
+		exit(1);
+	}
+
+	do {
+		/* done is read first, the events pushed before it are all there */
+		finished = atomic_load(&done);
+		while (input_ring_pop(&ring, &event)) {
+			if ((event.dx != ((event.seq & 1) ? 1 : -1))
+					|| (event.stamp.tv_sec != (time_t)event.seq)
+					|| (event.stamp.tv_nsec != (long)(event.seq % 1000000000UL))) {
+				torn++;
+			}
+			if (event.seq <= last) {
+				disorder++;
+			}
+			last = event.seq;
+			if ((++popped % PAUSE_EVERY) == 0) {
+				for (i = 0; i < 100; i++) {
+					sched_yield();
+				}
+			}
+		}
+		/* the producer may share the processor with us */
+		sched_yield();
+	} while (!finished);
+	pthread_join(producer, NULL);
+
+	lost = EVENTS - popped - ring.dropped;
+	printf("Ring: %lu pushed, %lu popped, %lu dropped, %lu lost, %lu torn, %lu out of order: %s\n",
+			EVENTS, popped, ring.dropped, lost, torn, disorder,
+			(lost || torn || disorder) ? "FAILED" : "ok");
+	return (lost || torn || disorder) ? 1 : 0;
+}
+
+void*
+produce(void* unused)
+{
+	struct input_event event;
+	unsigned long seq;
+
+	for (seq = 1; seq <= EVENTS; seq++) {
+		event.seq = seq;
+		event.dx = (seq & 1) ? 1 : -1;
+		event.stamp.tv_sec = seq;
+		event.stamp.tv_nsec = seq % 1000000000UL;
+		while ((seq % BURST_PERIOD >= BURST)
+				&& (atomic_load(&ring.head) - atomic_load(&ring.tail) == INPUT_RING_SIZE)) {
+			sched_yield();
+		}
+		input_ring_push(&ring, &event);
+	}
+	atomic_store(&done, 1);
+	return NULL;
+}
@@ -0,0 +1,280 @@
+/**
+ * rowstore
+ *
+ * The rows of a map while it is edited, like a tape: it is recorded at
+ * the cursor, which can be wound to any row to record over what is
+ * there, and every take can be undone and redone.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rowstore.h"
+
+/**
+ * The place of a row on a tape, a chunk is added if the row is the
+ * first one behind the last chunk.
+ *
+ * @return the row, NULL without memory or if it is further behind.
+ */
+static struct rowstore_row*
+tape_at(struct rowstore_tape* tape, size_t row, int grow)
+{
+	struct rowstore_row** grown;
+	size_t chunk = row / ROWSTORE_CHUNK;
+
+	if (chunk < tape->nchunks) {
+		return &tape->chunks[chunk][row % ROWSTORE_CHUNK];
+	}
+	if (!grow || (chunk > tape->nchunks)) {
+		return NULL;
+	}
+
+	/* only the pointers move, never the rows */
+	if (tape->nchunks == tape->capacity) {
+		grown = realloc(tape->chunks, sizeof(*grown) * (tape->capacity ? 2 * tape->capacity : 64));
+		if (grown == NULL) {
+			return NULL;
+		}
+		tape->chunks = grown;
+		tape->capacity = tape->capacity ? 2 * tape->capacity : 64;
+	}
+	tape->chunks[tape->nchunks] = malloc(sizeof(struct rowstore_row) * ROWSTORE_CHUNK);
+	if (tape->chunks[tape->nchunks] == NULL) {
+		return NULL;
+	}
+	tape->nchunks++;
+
+	return &tape->chunks[chunk][row % ROWSTORE_CHUNK];
+}
+
+/**
+ * Releases the chunks of a tape.
+ */
+static void
+tape_free(struct rowstore_tape* tape)
+{
+	size_t i;
+
+	for (i = 0; i < tape->nchunks; i++) {
+		free(tape->chunks[i]);
+	}
+	free(tape->chunks);
+	memset(tape, 0, sizeof(*tape));
+}
+
+/**
+ * Starts a take, whatever was undone can not be redone after that.
+ *
+ * @return the take, NULL without memory.
+ */
+static struct rowstore_take*
+begin_take(struct rowstore* store, size_t new_length)
+{
+	struct rowstore_take* grown;
+	struct rowstore_take* take;
+
+	if (store->done == store->capacity) {
+		grown = realloc(store->takes, sizeof(*grown) * (store->capacity ? 2 * store->capacity : 64));
+		if (grown == NULL) {
+			return NULL;
+		}
+		store->takes = grown;
+		store->capacity = store->capacity ? 2 * store->capacity : 64;
+	}
+
+	/* the journal of the takes undone is given up */
+	store->journal_length = store->done
+		? store->takes[store->done - 1].journal + store->takes[store->done - 1].saved
+		: 0;
+
+	take = &store->takes[store->done++];
+	store->total = store->done;
+	take->start = store->cursor;
+	take->count = 0;
+	take->old_length = store->length;
+	take->new_length = new_length;
+	take->journal = store->journal_length;
+	take->saved = 0;
+	take->used = store->used;
+	return take;
+}
+
+/**
+ * Exchanges the rows a take recorded with the ones it recorded over,
+ * both undo and redo.
+ */
+static void
+swap_take(struct rowstore* store, const struct rowstore_take* take)
+{
+	struct rowstore_row* row;
+	struct rowstore_row* saved;
+	struct rowstore_row swap;
+	size_t i;
+
+	for (i = 0; i < take->saved; i++) {
+		row = tape_at(&store->rows, take->start + i, 0);
+		saved = tape_at(&store->journal, take->journal + i, 0);
+		swap = *row;
+		*row = *saved;
+		*saved = swap;
+	}
+}
+
+void
+rowstore_init(struct rowstore* store)
+{
+	memset(store, 0, sizeof(*store));
+}
+
+void
+rowstore_free(struct rowstore* store)
+{
+	tape_free(&store->rows);
+	tape_free(&store->journal);
+	free(store->takes);
+	memset(store, 0, sizeof(*store));
+}
+
+int
+rowstore_record(struct rowstore* store, unsigned int left, unsigned int right)
+{
+	struct rowstore_take* take;
+	struct rowstore_row* row;
+	struct rowstore_row* saved = NULL;
+	size_t total = store->total;
+	size_t journal_length = store->journal_length;
+
+	if (!store->recording) {
+		if (begin_take(store, store->length) == NULL) {
+			return -1;
+		}
+		store->recording = 1;
+	}
+	take = &store->takes[store->done - 1];
+
+	/* both places first, so a row is never half recorded */
+	row = tape_at(&store->rows, store->cursor, 1);
+	if ((row != NULL) && (store->cursor < take->used)) {
+		saved = tape_at(&store->journal, store->journal_length, 1);
+	}
+	if ((row == NULL) || ((store->cursor < take->used) && (saved == NULL))) {
+		/* a take without a row would make undo do nothing, nothing changed
+		   so what could be redone still can */
+		if (take->count == 0) {
+			store->done--;
+			store->total = total;
+			store->journal_length = journal_length;
+			store->recording = 0;
+		}
+		return -1;
+	}
+
+	if (saved != NULL) {
+		*saved = *row;
+		store->journal_length++;
+		take->saved++;
+	}
+	row->left = left;
+	row->right = right;
+
+	store->cursor++;
+	take->count++;
+	if (store->cursor > store->length) {
+		store->length = store->cursor;
+	}
+	if (store->cursor > store->used) {
+		store->used = store->cursor;
+	}
+	take->new_length = store->length;
+	return 0;
+}
+
+int
+rowstore_get(const struct rowstore* store, size_t row, unsigned int* left, unsigned int* right)
+{
+	const struct rowstore_row* p;
+
+	if (row >= store->length) {
+		return 0;
+	}
+	p = &store->rows.chunks[row / ROWSTORE_CHUNK][row % ROWSTORE_CHUNK];
+	*left = p->left;
+	*right = p->right;
+	return 1;
+}
+
+void
+rowstore_seek(struct rowstore* store, size_t row)
+{
+	store->recording = 0;
+	store->cursor = (row < store->length) ? row : store->length;
+}
+
+int
+rowstore_truncate(struct rowstore* store)
+{
+	store->recording = 0;
+	if (store->cursor >= store->length) {
+		return 0;
+	}
+	/* the rows stay where they are, only the length changes */
+	if (begin_take(store, store->cursor) == NULL) {
+		return -1;
+	}
+	store->length = store->cursor;
+	return 0;
+}
+
+int
+rowstore_undo(struct rowstore* store)
+{
+	const struct rowstore_take* take;
+
+	store->recording = 0;
+	if (store->done == 0) {
+		return 0;
+	}
+
+	take = &store->takes[--store->done];
+	swap_take(store, take);
+	store->length = take->old_length;
+	store->cursor = take->start;
+	return 1;
+}
+
+int
+rowstore_redo(struct rowstore* store)
+{
+	const struct rowstore_take* take;
+
+	store->recording = 0;
+	if (store->done == store->total) {
+		return 0;
+	}
+
+	take = &store->takes[store->done++];
+	swap_take(store, take);
+	store->length = take->new_length;
+	store->cursor = take->start + take->count;
+	return 1;
+}
@@ -0,0 +1,155 @@
+/**
+ * rowstore
+ *
+ * The rows of a map while it is edited, like a tape: it is recorded at
+ * the cursor, which can be wound to any row to record over what is
+ * there, and every take can be undone and redone.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef ROWSTORE_H
+#define ROWSTORE_H
+
+#include <stddef.h>
+
+/* rows per chunk, chunks are never moved or copied once allocated */
+#define ROWSTORE_CHUNK 4096
+
+/**
+ * A row as the editors keep it.
+ */
+struct rowstore_row {
+	unsigned short left;
+	unsigned short right;
+};
+
+/**
+ * Rows in chunks of ROWSTORE_CHUNK, growing at the end.
+ */
+struct rowstore_tape {
+	struct rowstore_row** chunks;
+	size_t nchunks;
+	size_t capacity;
+};
+
+/**
+ * A change that can be undone: rows recorded from start on, or the
+ * rows from start on cut off.
+ */
+struct rowstore_take {
+	size_t start;
+	size_t count;
+	size_t old_length;
+	size_t new_length;
+	/* where the rows recorded over are kept in the journal, and how many */
+	size_t journal;
+	size_t saved;
+	/* the rows ever stored when the take began, all of them are kept
+	   when they are recorded over, not only the ones in the map then */
+	size_t used;
+};
+
+/**
+ * The rows of a map, the cursor and what can be undone.
+ */
+struct rowstore {
+	struct rowstore_tape rows;
+	/* the rows a take recorded over, undo and redo swap them back */
+	struct rowstore_tape journal;
+	size_t journal_length;
+
+	/* rows in the map, and ever stored, some may be cut off or undone */
+	size_t length;
+	size_t used;
+	/* the row recorded next */
+	size_t cursor;
+
+	/* the takes done, followed by the ones undone that can be redone */
+	struct rowstore_take* takes;
+	size_t done;
+	size_t total;
+	size_t capacity;
+	/* whether the last take done is still being recorded */
+	int recording;
+};
+
+/**
+ * Starts an empty map.
+ */
+void
+rowstore_init(struct rowstore* store);
+
+/**
+ * Releases all rows and takes.
+ */
+void
+rowstore_free(struct rowstore* store);
+
+/**
+ * Records a row at the cursor, over the one there if there is one, and
+ * moves the cursor on. The rows recorded one after another are a take,
+ * until the cursor is moved or a take is undone.
+ *
+ * @return 0 on success, -1 without memory.
+ */
+int
+rowstore_record(struct rowstore* store, unsigned int left, unsigned int right);
+
+/**
+ * Reads a row.
+ *
+ * @return 1 if there is such a row, else 0.
+ */
+int
+rowstore_get(const struct rowstore* store, size_t row, unsigned int* left, unsigned int* right);
+
+/**
+ * Winds the cursor to a row, at most to the end of the map. The take
+ * being recorded ends.
+ */
+void
+rowstore_seek(struct rowstore* store, size_t row);
+
+/**
+ * Cuts off the rows from the cursor on, as a take of its own.
+ *
+ * @return 0 on success, -1 without memory.
+ */
+int
+rowstore_truncate(struct rowstore* store);
+
+/**
+ * Undoes the last take, the cursor goes to where it started.
+ *
+ * @return 1 if there was one, else 0.
+ */
+int
+rowstore_undo(struct rowstore* store);
+
+/**
+ * Does the last take undone again, the cursor goes to where it ended.
+ *
+ * @return 1 if there was one, else 0.
+ */
+int
+rowstore_redo(struct rowstore* store);
+
+#endif
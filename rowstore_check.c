@@ -0,0 +1,235 @@
+/**
+ * rowstore_check
+ *
+ * Records, seeks, cuts off, undoes and redoes at random on a rowstore and
+ * on a plain copy of the rows for every take, and checks after every step
+ * that both have the same rows, length and cursor.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rowstore.h"
+
+/* runs of steps from an empty map, and the steps of each */
+#define RUNS 500
+#define STEPS 40
+
+/* the rows a map gets at most, more than two chunks */
+#define MAX_ROWS (2 * ROWSTORE_CHUNK + 512)
+
+/**
+ * The rows of the map as they are meant to be.
+ */
+struct state {
+	struct rowstore_row rows[MAX_ROWS];
+	size_t length;
+};
+
+/**
+ * What the rowstore should do, with whole copies of the rows: a take
+ * done keeps the rows from before it, one undone those from after it.
+ */
+struct model {
+	struct state now;
+	size_t cursor;
+	int recording;
+
+	struct state takes[STEPS];
+	size_t start[STEPS];
+	size_t end[STEPS];
+	size_t done;
+	size_t total;
+};
+
+struct model model;
+
+/**
+ * Begins a take in the model, whatever was undone is lost.
+ */
+void
+model_take(void);
+
+/**
+ * Whether the rowstore has the rows, the length and the cursor of the
+ * model, prints the first difference if not.
+ */
+int
+same(const struct rowstore* store);
+
+/**
+ * Exchanges the rows of the model with those kept for a take.
+ */
+void
+model_swap(size_t take);
+
+int main(int argc, char** argv)
+{
+	struct rowstore store;
+	unsigned int left;
+	unsigned int right;
+	unsigned long steps = 0;
+	unsigned long rows = 0;
+	size_t count;
+	size_t row;
+	size_t i;
+	int run;
+	int step;
+	int op;
+	int result;
+
+	srand(1);
+	for (run = 0; run < RUNS; run++) {
+		rowstore_init(&store);
+		memset(&model, 0, sizeof(model));
+
+		for (step = 0; step < STEPS; step++) {
+			op = rand() % 100;
+			if (op < 40) {
+				/* a run of rows, now and then over a chunk boundary */
+				count = (rand() % 8) ? 1 + rand() % 64 : 1 + rand() % (ROWSTORE_CHUNK + 256);
+				for (i = 0; (i < count) && (model.cursor < MAX_ROWS); i++) {
+					left = rand() % 40;
+					right = left + 3 + rand() % 40;
+					if (rowstore_record(&store, left, right) < 0) {
+						printf("Run %d, step %d: out of memory.\n", run, step);
+						exit(4);
+					}
+					if (!model.recording) {
+						model_take();
+						model.recording = 1;
+					}
+					model.now.rows[model.cursor].left = left;
+					model.now.rows[model.cursor].right = right;
+					model.cursor++;
+					if (model.cursor > model.now.length) {
+						model.now.length = model.cursor;
+					}
+					model.end[model.done - 1] = model.cursor;
+					rows++;
+				}
+			}
+			else if (op < 55) {
+				row = rand() % (model.now.length + 3);
+				rowstore_seek(&store, row);
+				model.recording = 0;
+				model.cursor = (row < model.now.length) ? row : model.now.length;
+			}
+			else if (op < 65) {
+				if (rowstore_truncate(&store) < 0) {
+					printf("Run %d, step %d: out of memory.\n", run, step);
+					exit(4);
+				}
+				model.recording = 0;
+				if (model.cursor < model.now.length) {
+					model_take();
+					model.now.length = model.cursor;
+				}
+			}
+			else if (op < 85) {
+				result = rowstore_undo(&store);
+				model.recording = 0;
+				if (result != (model.done > 0)) {
+					printf("Run %d, step %d: undo returned %d with %lu take(s) done.\n",
+							run, step, result, (unsigned long)model.done);
+					exit(1);
+				}
+				if (model.done > 0) {
+					model_swap(--model.done);
+					model.cursor = model.start[model.done];
+				}
+			}
+			else {
+				result = rowstore_redo(&store);
+				model.recording = 0;
+				if (result != (model.done < model.total)) {
+					printf("Run %d, step %d: redo returned %d with %lu of %lu take(s) done.\n",
+							run, step, result, (unsigned long)model.done, (unsigned long)model.total);
+					exit(1);
+				}
+				if (model.done < model.total) {
+					model_swap(model.done);
+					model.cursor = model.end[model.done++];
+				}
+			}
+
+			steps++;
+			if (!same(&store)) {
+				printf("Run %d, step %d (%d): the rowstore is not what it should be.\n", run, step, op);
+				exit(1);
+			}
+		}
+		rowstore_free(&store);
+	}
+
+	printf("Rowstore: %d runs, %lu steps, %lu rows recorded: ok\n", RUNS, steps, rows);
+	return 0;
+}
+
+void
+model_take(void)
+{
+	model.takes[model.done] = model.now;
+	model.start[model.done] = model.cursor;
+	model.end[model.done] = model.cursor;
+	model.done++;
+	model.total = model.done;
+}
+
+void
+model_swap(size_t take)
+{
+	static struct state swap;
+
+	swap = model.now;
+	model.now = model.takes[take];
+	model.takes[take] = swap;
+}
+
+int
+same(const struct rowstore* store)
+{
+	unsigned int left;
+	unsigned int right;
+	size_t row;
+
+	if ((store->length != model.now.length) || (store->cursor != model.cursor)) {
+		printf("%lu rows with the cursor on %lu, %lu on %lu expected.\n",
+				(unsigned long)store->length, (unsigned long)store->cursor,
+				(unsigned long)model.now.length, (unsigned long)model.cursor);
+		return 0;
+	}
+	for (row = 0; row < model.now.length; row++) {
+		if (!rowstore_get(store, row, &left, &right)
+				|| (left != model.now.rows[row].left) || (right != model.now.rows[row].right)) {
+			printf("Row %lu is %u %u, %u %u expected.\n", (unsigned long)row, left, right,
+					model.now.rows[row].left, model.now.rows[row].right);
+			return 0;
+		}
+	}
+	if (rowstore_get(store, row, &left, &right)) {
+		printf("There is a row %lu behind the end.\n", (unsigned long)row);
+		return 0;
+	}
+	return 1;
+}
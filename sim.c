@@ -0,0 +1,89 @@
+/**
+ * sim
+ *
+ * The rules of the race without any terminal, timing or output.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <string.h>
+
+#include "sim.h"
+
+void
+sim_init(struct sim* sim, const struct track* track)
+{
+	memset(sim, 0, sizeof(*sim));
+	track_cursor_init(&sim->cursor, track);
+	sim->xpos = track->startpos;
+	sim->state = SIM_RUNNING;
+}
+
+int
+sim_step(struct sim* sim, int dx)
+{
+	if (sim->state != SIM_RUNNING) {
+		return sim->state;
+	}
+
+	if (!track_next(&sim->cursor, &sim->leftmargin, &sim->rightmargin)) {
+		sim->state = track_failed(&sim->cursor) ? SIM_ERROR : SIM_GOAL;
+		return sim->state;
+	}
+	sim->row++;
+
+	sim->xpos += dx;
+	if (sim_crashed(sim->xpos, sim->leftmargin, sim->rightmargin)) {
+		sim->state = SIM_CRASH;
+	}
+
+	return sim->state;
+}
+
+int
+sim_run(struct sim* sim, const signed char* moves, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; (i < count) && (sim->state == SIM_RUNNING); i++) {
+		sim_step(sim, moves[i]);
+	}
+	while (sim->state == SIM_RUNNING) {
+		sim_step(sim, 0);
+	}
+
+	return sim->state;
+}
+
+unsigned int
+sim_parse_moves(const char* keys, unsigned int length, signed char* moves)
+{
+	unsigned int count = 0;
+	unsigned int i;
+
+	for (i = 0; i < length; i++) {
+		if ((keys[i] == '\n') || (keys[i] == '\r')) {
+			continue;
+		}
+		moves[count++] = (keys[i] == 'j') ? -1 : (keys[i] == 'k') ? 1 : 0;
+	}
+
+	return count;
+}
@@ -0,0 +1,105 @@
+/**
+ * sim
+ *
+ * The rules of the race without any terminal, timing or output.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include "track.h"
+
+/* states of a race */
+#define SIM_RUNNING 0
+#define SIM_CRASH   1
+#define SIM_GOAL    2
+/* the map broke off at a bad row, the race has no result */
+#define SIM_ERROR   3
+
+/**
+ * A race in progress.
+ */
+struct sim {
+	struct track_cursor cursor;
+	/* position of the car/ship/whatever */
+	int xpos;
+	/* number of rows passed, the crash row included */
+	unsigned int row;
+	/* the current row */
+	unsigned int leftmargin;
+	unsigned int rightmargin;
+	/* SIM_RUNNING, SIM_CRASH, SIM_GOAL or SIM_ERROR */
+	int state;
+};
+
+/**
+ * The one rule of the game: stay on the track.
+ *
+ * @return true if the position is off the track.
+ */
+static inline int
+sim_crashed(int xpos, unsigned int leftmargin, unsigned int rightmargin)
+{
+	return (xpos <= (int)leftmargin) || (xpos >= (int)rightmargin);
+}
+
+/**
+ * Puts the car on the start position of a track.
+ */
+void
+sim_init(struct sim* sim, const struct track* track);
+
+/**
+ * Advances the race by one row, like one frame of the racers.
+ *
+ * The next row is fetched, the position changed by the steering
+ * of that frame and then checked against the row.
+ *
+ * @param dx The steering applied in this row, -1 left, 1 right.
+ *
+ * @return the state of the race afterwards.
+ */
+int
+sim_step(struct sim* sim, int dx);
+
+/**
+ * Runs a whole race from a sequence of steering, one entry per row,
+ * rows without an entry are passed without steering.
+ *
+ * @param moves The steering of each row, -1, 0 or 1.
+ * @param count Number of entries in moves.
+ *
+ * @return the state at the end, sim->row tells where it ended.
+ */
+int
+sim_run(struct sim* sim, const signed char* moves, unsigned int count);
+
+/**
+ * Converts steering keys ('j', 'k', anything else no steering) into
+ * moves for sim_run, line breaks are skipped.
+ *
+ * @return the number of moves stored, at most length.
+ */
+unsigned int
+sim_parse_moves(const char* keys, unsigned int length, signed char* moves);
+
+#endif
@@ -0,0 +1,236 @@
+/**
+ * solve
+ *
+ * Which positions can survive each row of a track, whether it can be
+ * won at all, and a way through it with as few keys pressed as possible.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "solve.h"
+
+/* the fewest rows between two kept rows */
+#define STRIDE_MIN 64
+
+/**
+ * The positions that survive a row, from the ones that survived the row
+ * before: one column to either side, between the margins.
+ */
+static struct solve_span
+forward(struct solve_span reach, unsigned int left, unsigned int right)
+{
+	struct solve_span next;
+
+	next.low = (reach.low - 1 > (int)left) ? reach.low - 1 : (int)left + 1;
+	next.high = (reach.high + 1 < (int)right) ? reach.high + 1 : (int)right - 1;
+	return next;
+}
+
+/**
+ * The positions of a row that lead to one of the next row that can
+ * still survive to the end.
+ */
+static struct solve_span
+backward(struct solve_span reach, struct solve_span next)
+{
+	struct solve_span feasible;
+
+	feasible.low = (reach.low > next.low - 1) ? reach.low : next.low - 1;
+	feasible.high = (reach.high < next.high + 1) ? reach.high : next.high + 1;
+	return feasible;
+}
+
+/**
+ * The square root, rounded down.
+ */
+static unsigned int
+root(unsigned int value)
+{
+	unsigned long guess = value;
+	unsigned long next;
+
+	if (value < 2) {
+		return value;
+	}
+	next = (guess + value / guess) / 2;
+	while (next < guess) {
+		guess = next;
+		next = (guess + value / guess) / 2;
+	}
+	return guess;
+}
+
+/**
+ * Computes the reachable positions of the rows of a segment again,
+ * from the row kept in front of it.
+ *
+ * @return the number of rows in the segment.
+ */
+static unsigned int
+load_segment(struct solve* solve, unsigned int segment)
+{
+	struct track_cursor cursor = solve->cursors[segment];
+	unsigned int first = segment * solve->stride;
+	unsigned int length = solve->rows - first;
+	unsigned int left;
+	unsigned int right;
+	unsigned int i;
+
+	if (length > solve->stride) {
+		length = solve->stride;
+	}
+
+	solve->span[0] = solve->reach[segment];
+	for (i = 1; i <= length; i++) {
+		track_next(&cursor, &left, &right);
+		solve->span[i] = forward(solve->span[i - 1], left, right);
+	}
+	return length;
+}
+
+int
+solve_init(struct solve* solve, const struct track* track)
+{
+	struct track_cursor cursor;
+	struct solve_span reach;
+	struct solve_span next;
+	unsigned int capacity;
+	unsigned int segment;
+	unsigned int length;
+	unsigned int left;
+	unsigned int right;
+	unsigned int row = 0;
+	int i;
+
+	memset(solve, 0, sizeof(*solve));
+	solve->track = track;
+	solve->xpos = track->startpos;
+
+	solve->stride = root(track->rows);
+	if (solve->stride < STRIDE_MIN) {
+		solve->stride = STRIDE_MIN;
+	}
+	capacity = track->rows / solve->stride + 1;
+	solve->cursors = malloc(sizeof(*solve->cursors) * capacity);
+	solve->reach = malloc(sizeof(*solve->reach) * capacity);
+	if ((solve->cursors == NULL) || (solve->reach == NULL)) {
+		solve_free(solve);
+		return -1;
+	}
+
+	/* from the start on, until the track ends or nothing survives */
+	reach.low = reach.high = track->startpos;
+	track_cursor_init(&cursor, track);
+	for (;;) {
+		if (row % solve->stride == 0) {
+			segment = row / solve->stride;
+			solve->cursors[segment] = cursor;
+			solve->reach[segment] = reach;
+		}
+
+		if (!track_next(&cursor, &left, &right)) {
+			break;
+		}
+		next = forward(reach, left, right);
+		if (next.low > next.high) {
+			solve->dead = row + 1;
+			break;
+		}
+		reach = next;
+		row++;
+	}
+
+	solve->rows = row;
+	solve->segments = (row + solve->stride - 1) / solve->stride;
+	solve->feasible = malloc(sizeof(*solve->feasible) * (solve->segments + 1));
+	solve->span = malloc(sizeof(*solve->span) * (solve->stride + 1));
+	if ((solve->feasible == NULL) || (solve->span == NULL)) {
+		solve_free(solve);
+		return -1;
+	}
+
+	/* back from the end, anything that survived the last row will do */
+	solve->feasible[solve->segments] = reach;
+	for (segment = solve->segments; segment-- > 0;) {
+		length = load_segment(solve, segment);
+		next = solve->feasible[segment + 1];
+		for (i = length - 1; i >= 0; i--) {
+			next = backward(solve->span[i], next);
+		}
+		solve->feasible[segment] = next;
+	}
+
+	return 0;
+}
+
+int
+solve_next(struct solve* solve)
+{
+	unsigned int segment;
+	unsigned int length;
+	struct solve_span* target;
+	int xpos;
+	int i;
+
+	if (solve->row >= solve->rows) {
+		return 0;
+	}
+
+	/* the feasible positions of the rows of the next segment */
+	if (solve->row % solve->stride == 0) {
+		segment = solve->row / solve->stride;
+		length = load_segment(solve, segment);
+		solve->span[length] = solve->feasible[segment + 1];
+		for (i = length - 1; i > 0; i--) {
+			solve->span[i] = backward(solve->span[i], solve->span[i + 1]);
+		}
+	}
+
+	/* only move if staying leaves no way to the end */
+	target = &solve->span[solve->row % solve->stride + 1];
+	xpos = solve->xpos;
+	if (xpos < target->low) {
+		xpos = target->low;
+	}
+	else if (xpos > target->high) {
+		xpos = target->high;
+	}
+
+	i = xpos - solve->xpos;
+	solve->xpos = xpos;
+	solve->row++;
+	return i;
+}
+
+void
+solve_free(struct solve* solve)
+{
+	free(solve->cursors);
+	free(solve->reach);
+	free(solve->feasible);
+	free(solve->span);
+	solve->cursors = NULL;
+	solve->reach = NULL;
+	solve->feasible = NULL;
+	solve->span = NULL;
+}
@@ -0,0 +1,96 @@
+/**
+ * solve
+ *
+ * Which positions can survive each row of a track, whether it can be
+ * won at all, and a way through it with as few keys pressed as possible.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef SOLVE_H
+#define SOLVE_H
+
+#include "track.h"
+
+/**
+ * Positions from low to high, none if low > high.
+ *
+ * The car moves one column per row at most and a row keeps the columns
+ * between its margins, so the positions that survive a row are always
+ * such a span, never scattered.
+ */
+struct solve_span {
+	int low;
+	int high;
+};
+
+/**
+ * A track solved, and the plan through it row by row.
+ *
+ * Only every stride-th row is kept, about the square root of the rows;
+ * the rows in between are computed again from there when needed.
+ */
+struct solve {
+	const struct track* track;
+	/* rows the plan survives, all of them if the track can be won */
+	unsigned int rows;
+	/* the first row no position survives, 0 if the track can be won */
+	unsigned int dead;
+	unsigned int stride;
+	unsigned int segments;
+	/* at every stride-th row: the cursor, the positions reachable from
+	   the start and the ones of those that can still survive to the end */
+	struct track_cursor* cursors;
+	struct solve_span* reach;
+	struct solve_span* feasible;
+	/* the rows of the segment being planned */
+	struct solve_span* span;
+	/* rows planned so far */
+	unsigned int row;
+	int xpos;
+};
+
+/**
+ * Solves a track, reading it three times from the start in all.
+ *
+ * @param track A loaded track, a streamed one can not be read again.
+ *
+ * @return 0 on success, -1 without memory.
+ */
+int
+solve_init(struct solve* solve, const struct track* track);
+
+/**
+ * The steering of the next row of the plan: the car only moves if it
+ * must, and then one column towards where it can still survive. Past
+ * the rows of the plan it goes straight.
+ *
+ * @return -1 left, 0 straight, 1 right.
+ */
+int
+solve_next(struct solve* solve);
+
+/**
+ * Releases the solution.
+ */
+void
+solve_free(struct solve* solve);
+
+#endif
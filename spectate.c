@@ -0,0 +1,216 @@
+/**
+ * spectate
+ *
+ * The rows of a race in shared memory, for race_view to watch.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "spectate.h"
+
+/* the feed to close at exit, if this is a racer */
+static struct spectate* owned = NULL;
+
+/**
+ * Tells the viewers the racer is gone, wherever it exits.
+ */
+static void
+spectate_atexit(void)
+{
+	if (owned != NULL) {
+		spectate_close(owned);
+	}
+}
+
+/**
+ * Shared memory names start with a slash, the user does not have to
+ * give one.
+ */
+static int
+set_name(struct spectate* feed, const char* name)
+{
+	if (strchr(name + (name[0] == '/'), '/') != NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (snprintf(feed->name, sizeof(feed->name), "%s%s", (name[0] == '/') ? "" : "/", name)
+			>= (int)sizeof(feed->name)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	return 0;
+}
+
+int
+spectate_create(struct spectate* feed, const char* name, unsigned int size, unsigned int startpos)
+{
+	struct spectate_ring* ring;
+	int fd;
+
+	memset(feed, 0, sizeof(*feed));
+	if (set_name(feed, name) < 0) {
+		return -1;
+	}
+
+	/* a viewer still attached to an old race keeps that one */
+	shm_unlink(feed->name);
+	fd = shm_open(feed->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+	if (ftruncate(fd, sizeof(*ring)) < 0) {
+		close(fd);
+		shm_unlink(feed->name);
+		return -1;
+	}
+
+	/* fresh from ftruncate it is all zero, no frame is complete */
+	ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ring == MAP_FAILED) {
+		shm_unlink(feed->name);
+		return -1;
+	}
+
+	ring->version = SPECTATE_VERSION;
+	ring->size = size;
+	ring->startpos = startpos;
+	/* last, a viewer checks it first */
+	atomic_thread_fence(memory_order_release);
+	ring->magic = SPECTATE_MAGIC;
+
+	feed->ring = ring;
+	feed->owner = 1;
+	owned = feed;
+	atexit(spectate_atexit);
+	return 0;
+}
+
+int
+spectate_attach(struct spectate* feed, const char* name)
+{
+	struct spectate_ring* ring;
+	struct stat st;
+	int fd;
+
+	memset(feed, 0, sizeof(*feed));
+	if (set_name(feed, name) < 0) {
+		return -1;
+	}
+
+	fd = shm_open(feed->name, O_RDONLY, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	if ((fstat(fd, &st) < 0) || (st.st_size != sizeof(*ring))) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	ring = mmap(NULL, sizeof(*ring), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ring == MAP_FAILED) {
+		return -1;
+	}
+	if ((ring->magic != SPECTATE_MAGIC) || (ring->version != SPECTATE_VERSION)) {
+		munmap(ring, sizeof(*ring));
+		errno = EINVAL;
+		return -1;
+	}
+	atomic_thread_fence(memory_order_acquire);
+
+	feed->ring = ring;
+	/* joining late, the race so far is not shown */
+	feed->next = atomic_load_explicit(&ring->head, memory_order_acquire);
+	return 0;
+}
+
+void
+spectate_close(struct spectate* feed)
+{
+	if (feed->ring == NULL) {
+		return;
+	}
+	if (feed->owner) {
+		atomic_store_explicit(&feed->ring->closed, 1, memory_order_release);
+		/* the viewers keep their mapping until they are done */
+		shm_unlink(feed->name);
+	}
+	if (owned == feed) {
+		owned = NULL;
+	}
+	munmap(feed->ring, sizeof(*feed->ring));
+	feed->ring = NULL;
+}
+
+int
+spectate_read(struct spectate* feed, struct spectate_frame* frame, int latest)
+{
+	struct spectate_ring* ring = feed->ring;
+	struct spectate_slot* slot;
+	uint64_t head;
+	uint64_t before;
+	uint64_t after;
+	int closed;
+
+	while (1) {
+		/* closed first, the last rows are published before it is set */
+		closed = atomic_load_explicit(&ring->closed, memory_order_acquire);
+		head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+		if (feed->next >= head) {
+			return closed ? -1 : 0;
+		}
+
+		/* whatever the racer overwrote or the viewer does not want is skipped */
+		if (latest && (head - feed->next > 1)) {
+			feed->skipped += head - 1 - feed->next;
+			feed->next = head - 1;
+		}
+		else if (head - feed->next > SPECTATE_SLOTS) {
+			feed->skipped += head - SPECTATE_SLOTS - feed->next;
+			feed->next = head - SPECTATE_SLOTS;
+		}
+
+		slot = &ring->slots[feed->next & (SPECTATE_SLOTS - 1)];
+		before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+		*frame = slot->frame;
+		atomic_thread_fence(memory_order_acquire);
+		after = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+
+		if ((before == after) && (before == 2 * (feed->next + 1))) {
+			feed->next++;
+			return 1;
+		}
+		/* the racer lapped the viewer while it was copying, try again */
+	}
+}
@@ -0,0 +1,165 @@
+/**
+ * spectate
+ *
+ * The rows of a race in shared memory, for race_view to watch. The
+ * racer never waits for a viewer, a viewer that falls behind skips rows.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef SPECTATE_H
+#define SPECTATE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* "TRSP" */
+#define SPECTATE_MAGIC 0x50535254u
+#define SPECTATE_VERSION 1
+
+/* rows the ring holds, a power of two */
+#define SPECTATE_SLOTS 1024u
+
+/**
+ * A row as the racer drew it.
+ */
+struct spectate_frame {
+	uint32_t row;
+	uint32_t leftmargin;
+	uint32_t rightmargin;
+	int32_t xpos;
+	/* SIM_RUNNING, SIM_CRASH, SIM_GOAL or SIM_ERROR */
+	int32_t state;
+};
+
+/**
+ * A slot of the ring, guarded by a sequence lock: the sequence is odd
+ * while the racer writes and 2 * (frame + 1) when frame is complete.
+ */
+struct spectate_slot {
+	atomic_uint_least64_t sequence;
+	struct spectate_frame frame;
+};
+
+/**
+ * The shared memory, written by a single racer.
+ */
+struct spectate_ring {
+	uint32_t magic;
+	uint32_t version;
+	/* Trackwidth in characters. */
+	uint32_t size;
+	uint32_t startpos;
+	/* the racer is gone */
+	atomic_int closed;
+	/* frames published so far */
+	_Alignas(64) atomic_uint_least64_t head;
+	_Alignas(64) struct spectate_slot slots[SPECTATE_SLOTS];
+};
+
+/**
+ * One side of the feed.
+ */
+struct spectate {
+	struct spectate_ring* ring;
+	/* the shared memory object, "/" and the name */
+	char name[256];
+	/* the racer owns the ring and removes it */
+	int owner;
+	/* the viewer: the next frame to read, frames skipped */
+	uint64_t next;
+	unsigned long skipped;
+};
+
+/**
+ * Creates the feed for a racer, an old one of the same name is replaced.
+ * It is closed at exit if the racer does not do it.
+ *
+ * @param name Name of the feed, the viewer attaches by it.
+ *
+ * @return 0 on success, -1 on error with errno set.
+ */
+int
+spectate_create(struct spectate* feed, const char* name, unsigned int size, unsigned int startpos);
+
+/**
+ * Attaches a viewer to the feed of a racer, read only.
+ *
+ * @return 0 on success, -1 on error with errno set, or if it is no feed.
+ */
+int
+spectate_attach(struct spectate* feed, const char* name);
+
+/**
+ * Marks the feed as closed and releases it, the racer removes it.
+ */
+void
+spectate_close(struct spectate* feed);
+
+/**
+ * Publishes a row, called by the racer only, it never waits.
+ */
+static inline void
+spectate_publish(struct spectate* feed, const struct spectate_frame* frame)
+{
+	struct spectate_ring* ring = feed->ring;
+	uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	struct spectate_slot* slot = &ring->slots[head & (SPECTATE_SLOTS - 1)];
+
+	atomic_store_explicit(&slot->sequence, 2 * head + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	slot->frame = *frame;
+	atomic_store_explicit(&slot->sequence, 2 * (head + 1), memory_order_release);
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * Publishes a row if there is a feed at all.
+ */
+static inline void
+spectate_row(struct spectate* feed, unsigned int row, unsigned int leftmargin,
+		unsigned int rightmargin, int xpos, int state)
+{
+	struct spectate_frame frame;
+
+	if (feed->ring == NULL) {
+		return;
+	}
+	frame.row = row;
+	frame.leftmargin = leftmargin;
+	frame.rightmargin = rightmargin;
+	frame.xpos = xpos;
+	frame.state = state;
+	spectate_publish(feed, &frame);
+}
+
+/**
+ * Reads the next row for a viewer. If the racer is more than a ring
+ * ahead, the rows in between are skipped and counted.
+ *
+ * @param latest Skip to the newest row instead of the next one.
+ *
+ * @return 1 if there was a row, 0 if there is none yet, -1 if there
+ *         is none and the racer is gone.
+ */
+int
+spectate_read(struct spectate* feed, struct spectate_frame* frame, int latest);
+
+#endif
@@ -34,6 +34,12 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "outbuf.h"
+#include "map_writer.h"
+#include "rowstore.h"
 
 #define DEFAULT_FILE "default.map"
 
@@ -45,13 +51,24 @@
 /**
  * The main game/editor loop.
  *
- * @param map The file where the map data is located.
+ * @param store Where the rows are recorded, it is saved afterwards.
  * @param startpos The position (in characters) where
  * 		  the car/ship/whatever should start.
  * @param size Trackwidth in characters.
  */
 void
-game(FILE* map, unsigned int startpos, unsigned int size);
+game(struct rowstore* store, unsigned int startpos, unsigned int size);
+
+/**
+ * The keys that wind the tape of rows, see the controls. Recording is
+ * paused by all of them.
+ *
+ * @param count The number typed in front of the key, 0 for none.
+ *
+ * @return 1 if it was one of them, 0 if not, -1 without memory.
+ */
+int
+tape_control(struct rowstore* store, char key, unsigned long count);
 
 /**
  * Sets the terminal attributes. (no icanon, no echo)
@@ -74,9 +91,16 @@ getInt(FILE* stream);
 void
 unset_term_attr(void);
 
+/* everything a frame prints, written at once */
+struct outbuf screen;
+
 int main(int argc, char** argv)
 {
-	FILE* map;
+	struct map_writer map;
+	struct rowstore store;
+	unsigned int left;
+	unsigned int right;
+	size_t row;
 	unsigned int size = 0;
 	int startpos = 0;
 	int i;
@@ -85,22 +109,16 @@ int main(int argc, char** argv)
 		printf("No map name specified (%s <filename>)\n", argv[0]);
 		exit(2);
 	}
-	else {
-		map = fopen(argv[1], "w");
-	}
-
-	if (map == NULL) {
-		printf("Could not open map file. (%s <filename>)\n", argv[0]);
-		unset_term_attr();
-		exit(3);
-	}
-
 
 	/* print header */
 	printf("CONTROLS: 'j' for left, 'k' for right.\n"\
 		   "          's'/'d' move left line left/right\n"\
 		   "          'f'/'g' move right line left/right\n"\
 		   "          'c'/'v' make track smaller/bigger\n"\
+		   "          'p' pause/continue recording, 'u'/'r' undo/redo\n"\
+		   "          'b'/'n' one row back/forward, 'B'/'N' a hundred\n"\
+		   "          <row>'G' go to a row, 'G' to the end, 't' cut off the rest\n"\
+		   "          (recording goes on over the rows there)\n"\
 		   "          'Q' quit and save the map.\n");
 
 	printf("Map width (20 - 80): ");
@@ -116,7 +134,15 @@ int main(int argc, char** argv)
 	/* should be the best */
 	startpos = size / 2;
 
-	if (fprintf(map, "(%u)(%u)\n", size, startpos) < 6) {
+	/* the old map stays until the new one is saved */
+	if (map_writer_open(&map, argv[1]) < 0) {
+		printf("Could not open map file. (%s <filename>)\n", argv[0]);
+		unset_term_attr();
+		exit(3);
+	}
+
+	if (map_writer_header(&map, size, startpos) < 0) {
+		map_writer_abort(&map);
 		printf("There was an error writing the map file at line 1. (size)(startpos)\n");
 		unset_term_attr();
 		exit(3);
@@ -131,12 +157,38 @@ int main(int argc, char** argv)
 	putchar('|');
 	putchar('\n');
 	
+	/* a frame is a row and maybe the crash row */
+	if (outbuf_init(&screen, STDOUT_FILENO, 2 * (size + 3) + 64) < 0) {
+		map_writer_abort(&map);
+		printf("Not enough memory for the output buffer.\n");
+		unset_term_attr();
+		exit(4);
+	}
+	/* the frames bypass stdio from now on */
+	fflush(stdout);
+
 	/* time to read */
 	sleep(3);
 	
-	game(map, startpos, size);
+	rowstore_init(&store);
+	game(&store, startpos, size);
+
+	/* the map is saved as a whole at the end */
+	for (row = 0; rowstore_get(&store, row, &left, &right); row++) {
+		if (map_writer_row(&map, left, right) < 0) {
+			break;
+		}
+	}
+	rowstore_free(&store);
+	if (map_writer_close(&map) < 0) {
+		printf("There was an error saving the map file: %s.\n", strerror(errno));
+		unset_term_attr();
+		exit(7);
+	}
+	outbuf_report(&screen, stdout);
+	map_writer_report(&map, stdout);
+	outbuf_free(&screen);
 	
-	fclose(map);
 	unset_term_attr();
     return 0;
 }
@@ -191,17 +243,58 @@ unset_term_attr(void) {
     }
 }
 
+int
+tape_control(struct rowstore* store, char key, unsigned long count)
+{
+	size_t rows = count ? count : 1;
+
+	switch (key) {
+		case 'u':
+			rowstore_undo(store);
+			return 1;
+		case 'r':
+			rowstore_redo(store);
+			return 1;
+		case 'B':
+			rows *= 100;
+			/* fall through */
+		case 'b':
+			rowstore_seek(store, (store->cursor > rows) ? store->cursor - rows : 0);
+			return 1;
+		case 'N':
+			rows *= 100;
+			/* fall through */
+		case 'n':
+			rowstore_seek(store, store->cursor + rows);
+			return 1;
+		case 'G':
+			/* rows are counted from 1 like the lines */
+			rowstore_seek(store, count ? count - 1 : store->length);
+			return 1;
+		case 't':
+			return (rowstore_truncate(store) < 0) ? -1 : 1;
+	}
+	return 0;
+}
+
 void
-game(FILE* map, unsigned int startpos, unsigned int size) {
+game(struct rowstore* store, unsigned int startpos, unsigned int size) {
 	char c;
-    char line[size+1U];
+    char line[size+2U];
+	char status[64];
 	int result  = 0;
     unsigned int running = 1;
+	unsigned int paused = 0;
+	unsigned int changed = 0;
+	unsigned long count = 0;
 	unsigned int xmin = 1;
 	unsigned int xmax = size - 1;
 	unsigned int leftmargin  = startpos - (size/3);
 	unsigned int rightmargin = startpos + (size/3);
-	unsigned int nmbr = 2;
+	unsigned int firstleft = leftmargin;
+	unsigned int firstright = rightmargin;
+	unsigned int left;
+	unsigned int right;
 
     fd_set inset;
     struct timeval timeout;
@@ -218,13 +311,13 @@ game(FILE* map, unsigned int startpos, unsigned int size) {
         FD_ZERO(&inset);
         FD_SET(fileno(stdin), &inset);
 
-		/* writing the track, line by line */
-		if (fprintf(map, "%u %u\n", leftmargin, rightmargin) < 4) {
-			printf("There was an error writing the map file. Line: %d\n", nmbr);
+		/* recording the track, line by line, over what is at the cursor */
+		if (!paused && (rowstore_record(store, leftmargin, rightmargin) < 0)) {
+			printf("Not enough memory for more rows, saving the map. Line: %lu\n",
+					(unsigned long)store->cursor + 2);
     		FD_CLR(fileno(stdin), &inset);
-			exit(7);
+			return;
 		}
-		nmbr++;
 
         /* Wait TIMEOUT for new data */
         result = select(fileno(stdin)+1, &inset, NULL, NULL, &timeout);
@@ -239,8 +332,12 @@ game(FILE* map, unsigned int startpos, unsigned int size) {
         if (result && FD_ISSET(fileno(stdin), &inset)) {
 			c = getchar();
 
+			// a row or a number of rows for the next key, the frame goes on
+			if (isdigit((unsigned char)c)) {
+				count = count * 10 + (c - '0');
+			}
 			// move left
-			if (c == 'j') {
+			else if (c == 'j') {
 				if (leftmargin > xmin) {
 					leftmargin--;
 					rightmargin--;
@@ -291,6 +388,12 @@ game(FILE* map, unsigned int startpos, unsigned int size) {
 					rightmargin++;
 				}
 			}
+			// pause or continue, a new take either way
+			else if (c == 'p') {
+				paused = !paused;
+				rowstore_seek(store, store->cursor);
+				changed = 1;
+			}
             /* Picard on holo deck: "Computer, exit!" */
             else if ((c == 'Q') || (c == EOF)) {
             	printf("Saved the map, bye.\n");
@@ -298,13 +401,56 @@ game(FILE* map, unsigned int startpos, unsigned int size) {
     			FD_CLR(fileno(stdin), &inset);
 				return;
             }
+			else {
+				result = tape_control(store, c, count);
+				if (result < 0) {
+					printf("Not enough memory to cut off the rows, saving the map.\n");
+    				FD_CLR(fileno(stdin), &inset);
+					return;
+				}
+				if (result) {
+					/* recording goes on from the row before the cursor */
+					if (!rowstore_get(store, store->cursor - 1, &leftmargin, &rightmargin)) {
+						leftmargin = firstleft;
+						rightmargin = firstright;
+					}
+					paused = 1;
+					changed = 1;
+				}
+			}
+			if (!isdigit((unsigned char)c)) {
+				count = 0;
+			}
         }
 		
-		if (running) {
+		/* paused, the row at the cursor is shown once it moved */
+		if (paused && changed) {
+			if (rowstore_get(store, store->cursor, &left, &right)) {
+				snprintf(status, sizeof(status), "  row %lu of %lu",
+						(unsigned long)store->cursor + 1, (unsigned long)store->length);
+			}
+			else {
+				left = leftmargin;
+				right = rightmargin;
+				snprintf(status, sizeof(status), "  end, %lu rows", (unsigned long)store->length);
+			}
+			line[left] = '#';
+			line[right] = '#';
+
+			outbuf_puts(&screen, line);
+			outbuf_line(&screen, status);
+			outbuf_flush(&screen);
+
+			line[left] = ' ';
+			line[right] = ' ';
+			changed = 0;
+		}
+		else if (!paused) {
 			line[leftmargin] = '#';
 			line[rightmargin] = '#';
 				
-			printf("%s\n", line);
+			outbuf_line(&screen, line);
+			outbuf_flush(&screen);
 
 			line[leftmargin] = ' ';
 			line[rightmargin] = ' ';
@@ -34,27 +34,47 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <termios.h>
-#include <sys/select.h>
-#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
+#include <sys/ioctl.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+#include "track.h"
+#include "sim.h"
+#include "outbuf.h"
+#include "render.h"
+#include "input.h"
+#include "spectate.h"
+#include "index.h"
+#include "replay.h"
+#include "hist.h"
+#include "trace.h"
 
 #define DEFAULT_FILE "default.map"
 
 #define FRAME_TARGET_MS 120000
 
+/* keys read at once at most */
+#define BUFFLEN 256
+
 /**
  * The main game loop.
  *
- * @param map The file where the map data is located.
- * @param startpos The position (in characters) where
- * 		  the car/ship/whatever should start.
- * @param size Trackwidth in characters.
+ * @param cursor On the row to start in, of the preloaded and
+ *        validated track.
+ * @param xpos Where the car starts.
+ * @param policy What a frame makes of the keys pressed since the
+ *        last one, INPUT_LATEST, INPUT_NET or INPUT_QUEUE.
  *
- * @return true if the goal was reached, else false.
+ * @return 1 if the goal was reached, 0 after a crash, -1 if a streamed
+ *         map broke off at a bad row.
  */
 int
-game(FILE* map, unsigned int startpos, unsigned int size);
+game(struct track_cursor* cursor, int xpos, int policy);
 
 /**
  * Sets the terminal attributes. (no icanon, no echo)
@@ -69,23 +89,116 @@ set_term_attr(void);
 void
 unset_term_attr(void);
 
+/* everything a frame prints, written at once */
+struct outbuf screen;
+
+/* how the rows are drawn */
+struct render view;
+
+/* the rows for race_view, if there is a feed */
+struct spectate feed;
+
+/* microseconds per row, those of the replay when one is played back */
+unsigned int period = FRAME_TARGET_MS;
+
+/* the race played back instead of the keys, the ghost and the race
+   recorded, if they are asked for */
+struct replay_racer replays;
+
+/* how long the oldest key a frame used took to the screen, and how far
+   the time between two frames is off the period */
+struct hist latency;
+struct hist jitter;
+/* when the last frame was written */
+struct timespec written;
+
+/**
+ * Takes the time a frame is written at, call it right after the write.
+ *
+ * @param applied The oldest key the frame used, NULL for none.
+ */
+void
+frame_written(const struct input_event* applied);
+
+/**
+ * Prints how to call the racer.
+ */
+void
+usage(const char* name);
+
 int main(int argc, char** argv)
 {
 	FILE* map;
-	unsigned int size = 0;
-	int startpos = 0;
+	struct track track;
+	struct track_cursor cursor;
+	const char* filename = DEFAULT_FILE;
+	unsigned int start = 0;
+	unsigned int errors;
+	int xpos;
+	int mode = RENDER_LINES;
+	int policy = INPUT_LATEST;
+	const char* spectators = NULL;
+	const char* hist_name = NULL;
+	const char* trace_name = NULL;
+	FILE* hist_file;
 	int i;
+	int c;
+
+	while ((c = getopt(argc, argv, "dc:S:r:R:p:g:H:T:")) != -1) {
+		switch (c) {
+			case 'd':
+				mode = RENDER_DIFF;
+				break;
+			case 'c':
+				policy = input_policy(optarg);
+				if (policy < 0) {
+					usage(argv[0]);
+					exit(2);
+				}
+				break;
+			case 'S':
+				spectators = optarg;
+				break;
+			case 'r':
+				/* rows are counted from 1 like the lines of the editors */
+				start = strtoul(optarg, NULL, 10);
+				if (start < 1) {
+					usage(argv[0]);
+					exit(2);
+				}
+				start--;
+				break;
+			case 'R':
+				replays.record_name = optarg;
+				break;
+			case 'p':
+				replays.play_name = optarg;
+				break;
+			case 'g':
+				replays.ghost_name = optarg;
+				break;
+			case 'H':
+				hist_name = optarg;
+				break;
+			case 'T':
+				trace_name = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				exit(2);
+		}
+	}
 
 	printf("Setting terminal attributes.\n\n");
 	set_term_attr();
 
-	if (argc != 2) {
+	if (argc - optind != 1) {
 		printf("No map specified, using default.map (%s <filename>)\n\n", argv[0]);
-		map = fopen(DEFAULT_FILE, "r");
 	}
 	else {
-		map = fopen(argv[1], "r");
+		filename = argv[optind];
 	}
+	map = fopen(filename, "r");
 
 	if (map == NULL) {
 		printf("Could not open map file. (%s <filename>)\n", argv[0]);
@@ -93,26 +206,79 @@ int main(int argc, char** argv)
 		exit(3);
 	}
 
-	if (fscanf(map, "(%u)(%u)", &size, &startpos) != 2) {
-		printf("There was an error in the map file at line 1. (size)(startpos)\n");
+	i = replay_racer_open(&replays, &start, &period);
+	if (i) {
+		unset_term_attr();
+		exit(i);
+	}
+
+	/* read the whole track before the race, nothing to parse while racing,
+	   unless it comes through a pipe, from the checkpoint before the start row
+	   if the map has an index */
+	errors = index_open(map, filename, start, &track, &cursor, &xpos);
+	fclose(map);
+	if (errors) {
+		printf("Found %u error(s) in the map file.\n", errors);
+		track_free(&track);
+		unset_term_attr();
+		exit(3);
+	}
+
+	i = replay_racer_start(&replays, &cursor, &xpos, period);
+	if (i) {
+		track_free(&track);
+		unset_term_attr();
+		exit(i);
+	}
+
+	if ((spectators != NULL) && (spectate_create(&feed, spectators, track.size, xpos) < 0)) {
+		printf("Could not create the spectator feed %s: %s.\n", spectators, strerror(errno));
+		track_free(&track);
 		unset_term_attr();
 		exit(3);
 	}
 
 	/* print header */
 	printf("CONTROLS: 'j' for left, 'k' for right.\n"\
-		   "(please make sure to have at least %d char width)\n", size);
+		   "(please make sure to have at least %d char width)\n", track.size);
 	
 	putchar('|');
-	for (i = 1; i < (size); i++) { putchar('-');}
+	for (i = 1; i < (track.size); i++) { putchar('-');}
 	putchar('|');
 	putchar('\n');
 	
+	/* a frame is a row and maybe the crash row */
+	if ((outbuf_init(&screen, STDOUT_FILENO, 2 * (track.size + 3) + 64) < 0)
+			|| (render_init(&view, &screen, track.size, mode) < 0)) {
+		printf("Not enough memory for the output buffer.\n");
+		unset_term_attr();
+		exit(4);
+	}
+	/* the frames bypass stdio from now on */
+	fflush(stdout);
+
+	/* written at exit, whichever way the race ends */
+	if ((trace_name != NULL) && (trace_open(trace_name) < 0)) {
+		printf("Could not open the trace file %s.\n", trace_name);
+		unset_term_attr();
+		exit(3);
+	}
+
+	hist_init(&latency, "Key to screen");
+	hist_init(&jitter, "Frame period error");
+
 	/* time to read */
 	sleep(3);
 	
 	/* start the game */
-	if (game(map, startpos, size)) {
+	i = game(&cursor, xpos, policy);
+	render_finish(&view);
+
+	if (i < 0) {
+		printf("The map broke off before its end, the race has no result.\n");
+		errors = 1;
+	}
+	else if (i) {
 		printf("################################# GOAL #############################\n\n");
 		printf("Congratulations, you reached the Goal.\n");
 	}
@@ -120,9 +286,46 @@ int main(int argc, char** argv)
 		printf("******************************** CRASH ****************************\n\n");
 		printf("Sorry, but you left the road, please try again.\n");
 	}
+	outbuf_report(&screen, stdout);
+	track_report(&track, stdout);
+	hist_report(&latency, stdout);
+	hist_report(&jitter, stdout);
+	if (hist_name != NULL) {
+		hist_file = fopen(hist_name, "w");
+		i = (hist_file == NULL) ? -1 : (hist_dump(&latency, hist_file) + hist_dump(&jitter, hist_file));
+		if (((hist_file != NULL) && (fclose(hist_file) != 0)) || (i < 0)) {
+			printf("There was an error writing the histograms to %s.\n", hist_name);
+		}
+	}
+	outbuf_free(&screen);
+	spectate_close(&feed);
+
+	replay_racer_close(&replays);
 	
+	track_free(&track);
 	unset_term_attr();
-    return 0;
+    return errors ? 3 : 0;
+}
+
+void
+usage(const char* name)
+{
+	printf("Usage: %s [-d] [-c latest|net|queue] [-S name] [-r row] [-R replay] [-p replay]\n"\
+		   "       [-g replay] [-H file] [-T file] [filename]\n"\
+		   "       -d only draw what changes, on the alternate screen\n"\
+		   "       -S publish the rows for race_view under that name\n"\
+		   "       -r start in that row, see track_index for long maps\n"\
+		   "       -R record the race to a replay, a race quit is not kept\n"\
+		   "       -p play a replay back instead of steering, from its start row\n"\
+		   "          and at its speed, 'Q' still quits\n"\
+		   "       -g race against the car of a replay, drawn as 'o', from its start row\n"\
+		   "       -H write the histograms of the latencies to a file, see hist.h\n"\
+		   "       -T write how long the phases of every row took to a file, as a\n"\
+		   "          trace for chrome://tracing or Perfetto\n"\
+		   "       -c what a row makes of the keys pressed since the last one:\n"\
+		   "          latest steers towards the last key (default),\n"\
+		   "          net towards where all keys add up to,\n"\
+		   "          queue takes the oldest key and keeps the others for later rows\n", name);
 }
 
 void
@@ -159,136 +362,210 @@ unset_term_attr(void) {
     }
 }
 
+void
+frame_written(const struct input_event* applied)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (applied != NULL) {
+		hist_record(&latency, hist_elapsed(&applied->stamp, &now));
+	}
+	/* early or late, it is off either way */
+	if ((written.tv_sec != 0) || (written.tv_nsec != 0)) {
+		hist_record(&jitter, llabs(hist_elapsed(&written, &now) - period * 1000LL));
+	}
+	written = now;
+}
+
 int
-game(FILE* map, unsigned int startpos, unsigned int size) {
-  char c;
-  char line[size+1U];
-  int xpos  = startpos;
+game(struct track_cursor* cursor, int xpos, int policy) {
+  char keys[BUFFLEN];
+  ssize_t count;
+  int pending;
+  struct timespec stamp;
+  struct input_ring steering;
+  struct input_event applied;
+  int dx;
   int result  = 0;
   unsigned int running = 1;
-  unsigned int xmin = 1;
-  unsigned int xmax = size - 1;
-  unsigned int leftmargin  = xmin;
-  unsigned int rightmargin = xmax;
-  unsigned int nmbr = 1;
-
-  fd_set inset;
-  struct timeval select_timeout;
-  struct timeval select_start;
-  struct timeval select_end;
-  struct timeval select_passed;
-  int moved = 0;
+  unsigned int leftmargin  = 0;
+  unsigned int rightmargin = 0;
+  unsigned int row = cursor->track->first + cursor->row;
+  /* rows raced so far, what the replays count */
+  unsigned int raced = 0;
+
+  int epfd;
+  int tfd;
+  struct epoll_event event;
+  struct epoll_event events[2];
+  struct itimerspec frame_timer;
+  uint64_t expirations;
   int next = 1;
+  int crashed;
+  unsigned long long phase;
+  int i;
+
+  memset(&steering, 0, sizeof(steering));
+  trace_thread("game");
+
+  /* wake up on input or when the frame is over, nothing else */
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  tfd  = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if ((epfd == -1) || (tfd == -1)) {
+    perror("epoll/timerfd");
+    unset_term_attr();
+    exit(1);
+  }
 
-  /* initialize track */
-  sprintf(line, "|%*c", size, '|');
-
-  while(running) {
-    /* wait for timeout, has to be set new everytime */
-    select_timeout.tv_sec  = 0;
-    select_timeout.tv_usec = 5000;
+  event.events = EPOLLIN;
+  event.data.fd = STDIN_FILENO;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, &event) == -1) {
+    perror("epoll_ctl");
+    unset_term_attr();
+    exit(1);
+  }
+  event.data.fd = tfd;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &event) == -1) {
+    perror("epoll_ctl");
+    unset_term_attr();
+    exit(1);
+  }
 
-    /* what stream should be monitored */
-    FD_ZERO(&inset);
-    FD_SET(fileno(stdin), &inset);
+  /* absolute deadlines, one FRAME_TARGET_MS after the other, they do not drift */
+  clock_gettime(CLOCK_MONOTONIC, &frame_timer.it_value);
+  frame_timer.it_interval.tv_sec  = period / 1000000;
+  frame_timer.it_interval.tv_nsec = (period % 1000000) * 1000L;
+  frame_timer.it_value.tv_sec  += frame_timer.it_interval.tv_sec;
+  frame_timer.it_value.tv_nsec += frame_timer.it_interval.tv_nsec;
+  if (frame_timer.it_value.tv_nsec >= 1000000000L) {
+    frame_timer.it_value.tv_sec++;
+    frame_timer.it_value.tv_nsec -= 1000000000L;
+  }
+  if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &frame_timer, NULL) == -1) {
+    perror("timerfd_settime");
+    unset_term_attr();
+    exit(1);
+  }
 
+  while(running) {
     if (next) {
 
-      /* getting the track, line by line */
-      result = fscanf(map, "%u %u", &leftmargin, &rightmargin);
-      if (result == EOF) {
-        FD_CLR(fileno(stdin), &inset);
+      /* getting the track, line by line, it is already validated */
+      phase = trace_begin();
+      result = track_next(cursor, &leftmargin, &rightmargin);
+      trace_end("fetch", phase);
+      if (!result) {
+        close(tfd);
+        close(epfd);
+        /* a bad row of a streamed map is no goal */
+        if (track_failed(cursor)) {
+          spectate_row(&feed, row, leftmargin, rightmargin, xpos, SIM_ERROR);
+          return -1;
+        }
+        spectate_row(&feed, row, leftmargin, rightmargin, xpos, SIM_GOAL);
+        replay_finish(&replays.recording, raced, SIM_GOAL);
         return 1;
       }
-      else if (result != 2) {
-        printf("There was an error in the map file. Line: %d\n", nmbr);
-        unset_term_attr();
-        FD_CLR(fileno(stdin), &inset);
-        exit(1);
-      }
-      nmbr++;
-
-      if ((leftmargin < xmin) || (leftmargin > xmax)) {
-        printf("There was an error in the map file. Line: %d\n", nmbr);
-        unset_term_attr();
-        FD_CLR(fileno(stdin), &inset);
-        exit(1);
-      }
 
-      if ((rightmargin < xmin) || (rightmargin > xmax)) {
-        printf("There was an error in the map file. Line: %d\n", nmbr);
-        unset_term_attr();
-        FD_CLR(fileno(stdin), &inset);
-        exit(1);
-      }
-
-      gettimeofday(&select_start, NULL);
+      row++;
       next = 0;
     }
-    
-    /* Wait TIMEOUT for new data */
-    result = select(fileno(stdin)+1, &inset, NULL, NULL, &select_timeout);
-    // drop every input but the latest
+
+    /* Wait for new data or the end of the frame */
+    phase = trace_begin();
+    result = epoll_wait(epfd, events, 2, -1);
+    trace_end("wait", phase);
     if (result == -1) {
-      perror("select");
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("epoll_wait");
       unset_term_attr();
-      FD_CLR(fileno(stdin), &inset);
       exit(1);
     }
 
-
-    /* isset is necessary, even if we know that there is input */
-    if (result && FD_ISSET(fileno(stdin), &inset)) {
-      c = getchar();
-
-      if (!moved) {
-        if (c == 'j') {
-          xpos--;
-          moved = 1;
+    for (i = 0; i < result; i++) {
+      if (events[i].data.fd == STDIN_FILENO) {
+        /* every key that is there, at once and without stdio buffering */
+        phase = trace_begin();
+        if ((ioctl(STDIN_FILENO, FIONREAD, &pending) < 0) || (pending < 1)) {
+          pending = 1;
         }
-        else if (c == 'k') {
-          xpos++;
-          moved = 1;
+        count = read(STDIN_FILENO, keys, (pending < BUFFLEN) ? pending : BUFFLEN);
+        clock_gettime(CLOCK_MONOTONIC, &stamp);
+
+        /* Picard on holo deck: "Computer, exit!" */
+        if ((count <= 0) || input_parse(keys, count, &stamp, &steering)) {
+          printf("Oh, and I shall quit, bye!\n");
+          if (replays.record_file != NULL) {
+            fclose(replays.record_file);
+            remove(replays.record_name);
+          }
+          unset_term_attr();
+          exit(0);
         }
-      }
-
-      /* Picard on holo deck: "Computer, exit!" */
-      if ((c == 'Q') || (c == EOF)) {
-        printf("Oh, and I shall quit, bye!\n");
-        unset_term_attr();
-        FD_CLR(fileno(stdin), &inset);
-        exit(0);
+        trace_end("input", phase);
       }
     }
 
-    if (running) {
-      gettimeofday(&select_end, NULL);
-      timersub(&select_end, &select_start, &select_passed);
-      if (FRAME_TARGET_MS - (select_passed.tv_sec * 1000000 + select_passed.tv_usec) < 0) {
-        moved = 0;
+    for (i = 0; i < result; i++) {
+      /* frames missed in between are not made up for, the race goes on */
+      if ((events[i].data.fd == tfd)
+          && (read(tfd, &expirations, sizeof(expirations)) == sizeof(expirations))) {
         next = 1;
 
-        line[leftmargin] = '#';
-        line[rightmargin] = '#';
-
-        line[xpos] = 'V';
-
-        printf("%s\n", line);
+        /* one column per row at most, whatever was pressed, the keys
+           only quit while a replay plays */
+        phase = trace_begin();
+        applied.dx = 0;
+        dx = replays.playing ? replay_next(&replays.playback, raced) : input_coalesce(&steering, policy, &applied);
+        xpos += dx;
+        /* replay_load checked the moves, but the car is never drawn off the line */
+        if (xpos < 0) {
+          xpos = 0;
+        }
+        else if (xpos > (int)cursor->track->size) {
+          xpos = cursor->track->size;
+        }
+        if (replays.record_file != NULL) {
+          replay_step(&replays.recording, raced, dx);
+        }
+        trace_end("input", phase);
+        view.ghost = (raced < replays.ghost_rows) ? replays.ghost_xpos[raced] : -1;
+        raced++;
 
-        line[xpos] = ' ';
-        line[leftmargin] = ' ';
-        line[rightmargin] = ' ';
+        phase = trace_begin();
+        render_row(&view, leftmargin, rightmargin, xpos);
+        trace_end("render", phase);
 
         /* Stay on the track */
-        if ((xpos <= leftmargin) || (xpos >= rightmargin)) {
-          line[xpos] = 'X';
-          printf("%s\n", line);
-
+        phase = trace_begin();
+        crashed = sim_crashed(xpos, leftmargin, rightmargin);
+        trace_end("collision", phase);
+        if (crashed) {
+          phase = trace_begin();
+          render_crash(&view, xpos);
+          outbuf_flush(&screen);
+          trace_end("write", phase);
+          frame_written(applied.dx ? &applied : NULL);
+          spectate_row(&feed, row, leftmargin, rightmargin, xpos, SIM_CRASH);
+          replay_finish(&replays.recording, raced, SIM_CRASH);
+
+          close(tfd);
+          close(epfd);
           return 0;
         }
+        phase = trace_begin();
+        outbuf_flush(&screen);
+        trace_end("write", phase);
+        frame_written(applied.dx ? &applied : NULL);
+        spectate_row(&feed, row, leftmargin, rightmargin, xpos, SIM_RUNNING);
       }
     }
   }
 
+  close(tfd);
+  close(epfd);
   return 1;
 }
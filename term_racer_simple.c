@@ -39,6 +39,8 @@
 #include <sys/types.h>
 #include <string.h>
 
+#include "outbuf.h"
+
 #define DEFAULT_FILE "default.map"
 
 // timeout in micro sekonds
@@ -70,6 +72,9 @@ set_term_attr(void);
 void
 unset_term_attr(void);
 
+/* everything a frame prints, written at once */
+struct outbuf screen;
+
 int main(int argc, char** argv)
 {
 	FILE* map;
@@ -109,6 +114,15 @@ int main(int argc, char** argv)
 	putchar('|');
 	putchar('\n');
 	
+	/* a frame is a row and maybe the crash row */
+	if (outbuf_init(&screen, STDOUT_FILENO, 2 * (size + 3)) < 0) {
+		printf("Not enough memory for the output buffer.\n");
+		unset_term_attr();
+		exit(4);
+	}
+	/* the frames bypass stdio from now on */
+	fflush(stdout);
+
 	/* time to read */
 	sleep(3);
 	
@@ -121,6 +135,8 @@ int main(int argc, char** argv)
 		printf("******************************** CRASH ****************************\n\n");
 		printf("Sorry, but you left the road, please try again.\n");
 	}
+	outbuf_report(&screen, stdout);
+	outbuf_free(&screen);
 	
 	unset_term_attr();
     return 0;
@@ -163,7 +179,7 @@ unset_term_attr(void) {
 int
 game(FILE* map, unsigned int startpos, unsigned int size) {
 	char c;
-    char line[size+1U];
+    char line[size+2U];
 	int xpos  = startpos;
 	int result  = 0;
     unsigned int running = 1;
@@ -251,7 +267,7 @@ game(FILE* map, unsigned int startpos, unsigned int size) {
 				
 			line[xpos] = 'V';
 
-			printf("%s\n", line);
+			outbuf_line(&screen, line);
 
 			line[xpos] = ' ';
 			line[leftmargin] = ' ';
@@ -260,10 +276,12 @@ game(FILE* map, unsigned int startpos, unsigned int size) {
 			/* Stay on the track */
 			if ((xpos <= leftmargin) || (xpos >= rightmargin)) {
 				line[xpos] = 'X';
-				printf("%s\n", line);
+				outbuf_line(&screen, line);
+				outbuf_flush(&screen);
 
 				return 0;
 			}
+			outbuf_flush(&screen);
 		}
     }
 
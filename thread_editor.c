@@ -30,8 +30,15 @@
 #include <unistd.h>
 #include <termios.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
 #include <pthread.h>
 
+#include "outbuf.h"
+#include "map_writer.h"
+#include "rowstore.h"
+#include "pace.h"
+
 #define DEFAULT_FILE "default.map"
 
 #define BUFFLEN 4
@@ -42,13 +49,24 @@
 /**
  * The main game/editor loop.
  *
- * @param map The file where the map data is located.
+ * @param store Where the rows are recorded, it is saved afterwards.
  * @param startpos The position (in characters) where
  * 		  the car/ship/whatever should start.
  * @param size Trackwidth in characters.
  */
 void
-game(FILE* map, unsigned int startpos, unsigned int size);
+game(struct rowstore* store, unsigned int startpos, unsigned int size);
+
+/**
+ * The keys that wind the tape of rows, see the controls. Recording is
+ * paused by all of them.
+ *
+ * @param count The number typed in front of the key, 0 for none.
+ *
+ * @return 1 if it was one of them, 0 if not, -1 without memory.
+ */
+int
+tape_control(struct rowstore* store, char key, unsigned long count);
 
 /**
  * Sets the terminal attributes. (no icanon, no echo)
@@ -80,14 +98,32 @@ get_user_input();
 pthread_mutex_t m_values = PTHREAD_MUTEX_INITIALIZER;
 unsigned int leftmargin;
 unsigned int rightmargin;
+/* the margins the map starts with, for a cursor on the first row */
+unsigned int firstleft;
+unsigned int firstright;
+
+/* the rows, the keys wind them and the game loop records them */
+struct rowstore* tape;
+unsigned int paused = 0;
+/* the cursor moved while paused, the row there is drawn */
+unsigned int changed = 0;
 
 unsigned int running = 1;
+
+/* everything a frame prints, written at once */
+struct outbuf screen;
+/* the deadlines of the rows */
+struct pace pace;
 unsigned int xmin = 1;
 unsigned int xmax = 1;
 
 int main(int argc, char** argv)
 {
-	FILE* map;
+	struct map_writer map;
+	struct rowstore store;
+	unsigned int left;
+	unsigned int right;
+	size_t row;
 	unsigned int size = 0;
 	int startpos = 0;
 	int i;
@@ -96,22 +132,16 @@ int main(int argc, char** argv)
 		printf("No map name specified (%s <filename>)\n", argv[0]);
 		exit(2);
 	}
-	else {
-		map = fopen(argv[1], "w");
-	}
-
-	if (map == NULL) {
-		printf("Could not open map file. (%s <filename>)\n", argv[0]);
-		unset_term_attr();
-		exit(3);
-	}
-
 
 	/* print header */
 	printf("CONTROLS: 'j' for left, 'k' for right.\n"\
 		   "          's'/'d' move left line left/right\n"\
 		   "          'f'/'g' move right line left/right\n"\
 		   "          'c'/'v' make track smaller/bigger\n"\
+		   "          'p' pause/continue recording, 'u'/'r' undo/redo\n"\
+		   "          'b'/'n' one row back/forward, 'B'/'N' a hundred\n"\
+		   "          <row>'G' go to a row, 'G' to the end, 't' cut off the rest\n"\
+		   "          (recording goes on over the rows there)\n"\
 		   "          'Q' quit and save the map.\n");
 
 	printf("Map width (20 - 80): ");
@@ -127,7 +157,15 @@ int main(int argc, char** argv)
 	/* should be the best */
 	startpos = size / 2;
 
-	if (fprintf(map, "(%u)(%u)\n", size, startpos) < 6) {
+	/* the old map stays until the new one is saved */
+	if (map_writer_open(&map, argv[1]) < 0) {
+		printf("Could not open map file. (%s <filename>)\n", argv[0]);
+		unset_term_attr();
+		exit(3);
+	}
+
+	if (map_writer_header(&map, size, startpos) < 0) {
+		map_writer_abort(&map);
 		printf("There was an error writing the map file at line 1. (size)(startpos)\n");
 		unset_term_attr();
 		exit(3);
@@ -142,12 +180,42 @@ int main(int argc, char** argv)
 	putchar('|');
 	putchar('\n');
 	
+	/* a frame is a row and maybe the crash row */
+	if (outbuf_init(&screen, STDOUT_FILENO, 2 * (size + 3) + 64) < 0) {
+		map_writer_abort(&map);
+		printf("Not enough memory for the output buffer.\n");
+		unset_term_attr();
+		exit(4);
+	}
+	/* the frames bypass stdio from now on */
+	fflush(stdout);
+
 	/* time to read */
 	sleep(3);
 	
-	game(map, startpos, size);
+	rowstore_init(&store);
+	game(&store, startpos, size);
+
+	/* the map is saved as a whole at the end, the input thread is
+	   done with the rows once running is 0 */
+	pthread_mutex_lock(&m_values);
+	for (row = 0; rowstore_get(&store, row, &left, &right); row++) {
+		if (map_writer_row(&map, left, right) < 0) {
+			break;
+		}
+	}
+	rowstore_free(&store);
+	pthread_mutex_unlock(&m_values);
+	if (map_writer_close(&map) < 0) {
+		printf("There was an error saving the map file: %s.\n", strerror(errno));
+		unset_term_attr();
+		exit(7);
+	}
+	outbuf_report(&screen, stdout);
+	map_writer_report(&map, stdout);
+	pace_report(&pace, stdout);
+	outbuf_free(&screen);
 	
-	fclose(map);
 	unset_term_attr();
     return 0;
 }
@@ -202,13 +270,56 @@ unset_term_attr(void) {
     }
 }
 
+int
+tape_control(struct rowstore* store, char key, unsigned long count)
+{
+	size_t rows = count ? count : 1;
+
+	switch (key) {
+		case 'u':
+			rowstore_undo(store);
+			return 1;
+		case 'r':
+			rowstore_redo(store);
+			return 1;
+		case 'B':
+			rows *= 100;
+			/* fall through */
+		case 'b':
+			rowstore_seek(store, (store->cursor > rows) ? store->cursor - rows : 0);
+			return 1;
+		case 'N':
+			rows *= 100;
+			/* fall through */
+		case 'n':
+			rowstore_seek(store, store->cursor + rows);
+			return 1;
+		case 'G':
+			/* rows are counted from 1 like the lines */
+			rowstore_seek(store, count ? count - 1 : store->length);
+			return 1;
+		case 't':
+			return (rowstore_truncate(store) < 0) ? -1 : 1;
+	}
+	return 0;
+}
+
 void*
 get_user_input()
 {
 	char c;
+	unsigned long count = 0;
+	int result;
+
 	while(running) {
 		c = getchar();
 
+		// a row or a number of rows for the next key
+		if (isdigit((unsigned char)c)) {
+			count = count * 10 + (c - '0');
+			continue;
+		}
+
 		// move left
 		if (c == 'j') {
 			pthread_mutex_lock(&m_values);
@@ -277,30 +388,61 @@ get_user_input()
 			}
 			pthread_mutex_unlock(&m_values);
 		}
+		// pause or continue, a new take either way
+		else if (c == 'p') {
+			pthread_mutex_lock(&m_values);
+			paused = !paused;
+			rowstore_seek(tape, tape->cursor);
+			changed = 1;
+			pthread_mutex_unlock(&m_values);
+		}
         /* Picard on holo deck: "Computer, exit!" */
         else if ((c == 'Q') || (c == EOF)) {
         	printf("Saved the map, bye.\n");
 			unset_term_attr();
 			pthread_mutex_lock(&m_values);
-			rightmargin = 0;
-			leftmargin = 0;
-			pthread_mutex_unlock(&m_values);
 			running = 0;
+			pthread_mutex_unlock(&m_values);
         }
+		else {
+			pthread_mutex_lock(&m_values);
+			result = tape_control(tape, c, count);
+			if (result < 0) {
+				printf("Not enough memory to cut off the rows, saving the map.\n");
+				running = 0;
+			}
+			else if (result) {
+				/* recording goes on from the row before the cursor */
+				if (!rowstore_get(tape, tape->cursor - 1, &leftmargin, &rightmargin)) {
+					leftmargin = firstleft;
+					rightmargin = firstright;
+				}
+				paused = 1;
+				changed = 1;
+			}
+			pthread_mutex_unlock(&m_values);
+		}
+		count = 0;
 	}
 	return NULL;
 }
 
 void
-game(FILE* map, unsigned int startpos, unsigned int size) {
-    char line[size+1U];
-	unsigned int nmbr = 2;
+game(struct rowstore* store, unsigned int startpos, unsigned int size) {
+    char line[size+2U];
+	char status[64];
+	unsigned int left;
+	unsigned int right;
+	unsigned int draw;
 	pthread_t pt_input;
 
 	xmin = 1;
 	xmax = size - 1;
 	leftmargin  = startpos - (size/3);
 	rightmargin = startpos + (size/3);
+	firstleft = leftmargin;
+	firstright = rightmargin;
+	tape = store;
 
 	/* initialize track */
 	sprintf(line, "|%*c", size, '|');
@@ -313,29 +455,62 @@ game(FILE* map, unsigned int startpos, unsigned int size) {
 		exit(1);
 	}
 
+	/* a row every TIMEOUT, however long drawing takes */
+	pace_start(&pace, TIMEOUT);
     while(running) {
 		pthread_mutex_lock(&m_values);
-		/* writing the track, line by line */
-		if (fprintf(map, "%u %u\n", leftmargin, rightmargin) < 4) {
-			printf("There was an error writing the map file. Line: %d\n", nmbr);
+		/* nothing is recorded after quitting */
+		if (!running) {
+			pthread_mutex_unlock(&m_values);
+			break;
+		}
+		left = leftmargin;
+		right = rightmargin;
+		status[0] = '\0';
+		draw = !paused;
+
+		/* recording the track, line by line, over what is at the cursor */
+		if (!paused && (rowstore_record(store, left, right) < 0)) {
+			printf("Not enough memory for more rows, saving the map. Line: %lu\n",
+					(unsigned long)store->cursor + 2);
 			running = 0;
-			unset_term_attr();
-			exit(7);
+			pthread_mutex_unlock(&m_values);
+			break;
 		}
-		nmbr++;
-		
-		if (running) {
-			line[leftmargin] = '#';
-			line[rightmargin] = '#';
-				
-			printf("%s\n", line);
-
-			line[leftmargin] = ' ';
-			line[rightmargin] = ' ';
+		/* paused, the row at the cursor is shown once it moved */
+		if (paused && changed) {
+			if (rowstore_get(store, store->cursor, &left, &right)) {
+				snprintf(status, sizeof(status), "  row %lu of %lu",
+						(unsigned long)store->cursor + 1, (unsigned long)store->length);
+			}
+			else {
+				snprintf(status, sizeof(status), "  end, %lu rows", (unsigned long)store->length);
+			}
+			changed = 0;
+			draw = 1;
 		}
 		pthread_mutex_unlock(&m_values);
 
-        /* Wait TIMEOUT for new data */
-		usleep(TIMEOUT);
+		if (draw) {
+			line[left] = '#';
+			line[right] = '#';
+
+			if (status[0] != '\0') {
+				outbuf_puts(&screen, line);
+				outbuf_line(&screen, status);
+			}
+			else {
+				outbuf_line(&screen, line);
+			}
+
+			line[left] = ' ';
+			line[right] = ' ';
+
+			/* the terminal is written outside of the lock */
+			outbuf_flush(&screen);
+		}
+
+        /* Wait for the deadline of the row, new data comes meanwhile */
+		pace_wait(&pace);
     }
 }
@@ -31,6 +31,20 @@
 #include <string.h>
 #include <termios.h>
 #include <pthread.h>
+#include <time.h>
+#include <errno.h>
+
+#include "track.h"
+#include "sim.h"
+#include "input.h"
+#include "outbuf.h"
+#include "render.h"
+#include "spectate.h"
+#include "index.h"
+#include "replay.h"
+#include "hist.h"
+#include "trace.h"
+#include "pace.h"
 
 #define DEFAULT_FILE "default.map"
 
@@ -40,15 +54,15 @@
 /**
  * The main game loop.
  *
- * @param map The file where the map data is located.
- * @param startpos The position (in characters) where
- * 		  the car/ship/whatever should start.
- * @param size Trackwidth in characters.
+ * @param cursor On the row to start in, of the preloaded and
+ *        validated track.
+ * @param xpos Where the car starts.
  *
- * @return true if the goal was reached, else false.
+ * @return 1 if the goal was reached, 0 after a crash, -1 if a streamed
+ *         map broke off at a bad row.
  */
 int
-game(FILE* map, unsigned int startpos, unsigned int size);
+game(struct track_cursor* cursor, int xpos);
 
 /**
  * Sets the terminal attributes. (no icanon, no echo)
@@ -69,28 +83,142 @@ unset_term_attr(void);
 void*
 get_user_input();
 
-pthread_mutex_t m_xpos = PTHREAD_MUTEX_INITIALIZER;
-int xpos;
+/* steering from the input thread to the game loop, no locks involved */
+struct input_ring steering;
 
 unsigned int running = 1;
 
+/* everything a frame prints, written at once */
+struct outbuf screen;
+
+/* how the rows are drawn */
+struct render view;
+
+/* the rows for race_view, if there is a feed */
+struct spectate feed;
+
+/* microseconds per row, those of the replay when one is played back */
+unsigned int period = TIMEOUT;
+
+/* the race played back instead of the keys, the ghost and the race
+   recorded, if they are asked for */
+struct replay_racer replays;
+
+/* how long the oldest key a frame used took to the screen, and how far
+   the time between two frames is off the period */
+struct hist latency;
+struct hist jitter;
+/* when the last frame was written */
+struct timespec written;
+
+/* the deadlines of the rows */
+struct pace pace;
+
+/* keys read by the input thread, numbered from 1, and what the game loop
+   made of them: applied, out of order and the number of the last one */
+unsigned long keys_read = 0;
+unsigned long keys_applied = 0;
+unsigned long keys_disorder = 0;
+unsigned long keys_last = 0;
+
+/* reads the keys while the game loop races */
+pthread_t input_thread;
+
+/**
+ * Takes the time a frame is written at, call it right after the write.
+ *
+ * @param applied The oldest key the frame used, NULL for none.
+ */
+void
+frame_written(const struct input_event* applied);
+
+/**
+ * Stops the input thread and waits for it, the keys it counted do not
+ * change after that.
+ */
+void
+stop_input(void);
+
+/**
+ * Prints what became of the keys read: applied, dropped because the ring
+ * was full, still in the ring at the end or lost without a trace, and
+ * how many came out of order. Call it after stop_input(), the input
+ * thread must not count while the keys are added up.
+ */
+void
+keys_report(FILE* stream);
+
+/**
+ * Prints how to call the racer.
+ */
+void
+usage(const char* name);
+
 int main(int argc, char** argv)
 {
 	FILE* map;
-	unsigned int size = 0;
-	int startpos = 0;
+	struct track track;
+	struct track_cursor cursor;
+	const char* filename = DEFAULT_FILE;
+	unsigned int start = 0;
+	unsigned int errors;
+	int xpos;
+	int mode = RENDER_LINES;
+	const char* spectators = NULL;
+	const char* hist_name = NULL;
+	const char* trace_name = NULL;
+	FILE* hist_file;
 	int i;
+	int c;
+
+	while ((c = getopt(argc, argv, "dS:r:R:p:g:H:T:")) != -1) {
+		switch (c) {
+			case 'd':
+				mode = RENDER_DIFF;
+				break;
+			case 'S':
+				spectators = optarg;
+				break;
+			case 'r':
+				/* rows are counted from 1 like the lines of the editors */
+				start = strtoul(optarg, NULL, 10);
+				if (start < 1) {
+					usage(argv[0]);
+					exit(2);
+				}
+				start--;
+				break;
+			case 'R':
+				replays.record_name = optarg;
+				break;
+			case 'p':
+				replays.play_name = optarg;
+				break;
+			case 'g':
+				replays.ghost_name = optarg;
+				break;
+			case 'H':
+				hist_name = optarg;
+				break;
+			case 'T':
+				trace_name = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				exit(2);
+		}
+	}
 
 	printf("Setting terminal attributes.\n\n");
 	set_term_attr();
 
-	if (argc != 2) {
+	if (argc - optind != 1) {
 		printf("No map specified, using default.map (%s <filename>)\n\n", argv[0]);
-		map = fopen(DEFAULT_FILE, "r");
 	}
 	else {
-		map = fopen(argv[1], "r");
+		filename = argv[optind];
 	}
+	map = fopen(filename, "r");
 
 	if (map == NULL) {
 		printf("Could not open map file. (%s <filename>)\n", argv[0]);
@@ -98,26 +226,80 @@ int main(int argc, char** argv)
 		exit(3);
 	}
 
-	if (fscanf(map, "(%u)(%u)", &size, &startpos) != 2) {
-		printf("There was an error in the map file at line 1. (size)(startpos)\n");
+	i = replay_racer_open(&replays, &start, &period);
+	if (i) {
+		unset_term_attr();
+		exit(i);
+	}
+
+	/* read the whole track before the race, nothing to parse while racing,
+	   unless it comes through a pipe, from the checkpoint before the start row
+	   if the map has an index */
+	errors = index_open(map, filename, start, &track, &cursor, &xpos);
+	fclose(map);
+	if (errors) {
+		printf("Found %u error(s) in the map file.\n", errors);
+		track_free(&track);
+		unset_term_attr();
+		exit(3);
+	}
+
+	i = replay_racer_start(&replays, &cursor, &xpos, period);
+	if (i) {
+		track_free(&track);
+		unset_term_attr();
+		exit(i);
+	}
+
+	if ((spectators != NULL) && (spectate_create(&feed, spectators, track.size, xpos) < 0)) {
+		printf("Could not create the spectator feed %s: %s.\n", spectators, strerror(errno));
+		track_free(&track);
 		unset_term_attr();
 		exit(3);
 	}
 
 	/* print header */
 	printf("CONTROLS: 'j' for left, 'k' for right. 'Q' to quit.\n"\
-		   "(please make sure to have at least %d char width)\n", size);
+		   "(please make sure to have at least %d char width)\n", track.size);
 	
 	putchar('|');
-	for (i = 1; i < (size); i++) { putchar('-');}
+	for (i = 1; i < (track.size); i++) { putchar('-');}
 	putchar('|');
 	putchar('\n');
 	
+	/* a frame is a row and maybe the crash row */
+	if ((outbuf_init(&screen, STDOUT_FILENO, 2 * (track.size + 3) + 64) < 0)
+			|| (render_init(&view, &screen, track.size, mode) < 0)) {
+		printf("Not enough memory for the output buffer.\n");
+		unset_term_attr();
+		exit(4);
+	}
+	/* the frames bypass stdio from now on */
+	fflush(stdout);
+
+	/* written at exit, whichever way the race ends */
+	if ((trace_name != NULL) && (trace_open(trace_name) < 0)) {
+		printf("Could not open the trace file %s.\n", trace_name);
+		unset_term_attr();
+		exit(3);
+	}
+
+	hist_init(&latency, "Key to screen");
+	hist_init(&jitter, "Frame period error");
+
 	/* time to read */
 	sleep(3);
 	
 	/* start the game */
-	if (game(map, startpos, size)) {
+	i = game(&cursor, xpos);
+	stop_input();
+	render_finish(&view);
+
+	if (i < 0) {
+		printf("The map broke off before its end, the race has no result.\n");
+		errors = 1;
+	}
+	else if (i) {
 		printf("################################# GOAL #############################\n\n");
 		printf("Congratulations, you reached the Goal.\n");
 	}
@@ -125,9 +307,44 @@ int main(int argc, char** argv)
 		printf("******************************** CRASH ****************************\n\n");
 		printf("Sorry, but you left the road, please try again.\n");
 	}
+	outbuf_report(&screen, stdout);
+	track_report(&track, stdout);
+	pace_report(&pace, stdout);
+	keys_report(stdout);
+	hist_report(&latency, stdout);
+	hist_report(&jitter, stdout);
+	if (hist_name != NULL) {
+		hist_file = fopen(hist_name, "w");
+		i = (hist_file == NULL) ? -1 : (hist_dump(&latency, hist_file) + hist_dump(&jitter, hist_file));
+		if (((hist_file != NULL) && (fclose(hist_file) != 0)) || (i < 0)) {
+			printf("There was an error writing the histograms to %s.\n", hist_name);
+		}
+	}
+	outbuf_free(&screen);
+	spectate_close(&feed);
+
+	replay_racer_close(&replays);
 	
+	track_free(&track);
 	unset_term_attr();
-    return 0;
+    return errors ? 3 : 0;
+}
+
+void
+usage(const char* name)
+{
+	printf("Usage: %s [-d] [-S name] [-r row] [-R replay] [-p replay] [-g replay]\n"\
+		   "       [-H file] [-T file] [filename]\n"\
+		   "       -d only draw what changes, on the alternate screen\n"\
+		   "       -S publish the rows for race_view under that name\n"\
+		   "       -r start in that row, see track_index for long maps\n"\
+		   "       -R record the race to a replay, a race quit is not kept\n"\
+		   "       -p play a replay back instead of steering, from its start row\n"\
+		   "          and at its speed, 'Q' still quits\n"\
+		   "       -g race against the car of a replay, drawn as 'o', from its start row\n"\
+		   "       -H write the histograms of the latencies to a file, see hist.h\n"\
+		   "       -T write how long the phases of every row took to a file, as a\n"\
+		   "          trace for chrome://tracing or Perfetto\n", name);
 }
 
 void
@@ -168,109 +385,187 @@ void*
 get_user_input()
 {
 	int c;
+	struct input_event event;
+	unsigned long long phase;
+
+	trace_thread("input");
 	while(running) {
+		phase = trace_begin();
 		c = getchar();
+		trace_end("key wait", phase);
 	
-		if (c == 'j') {
-			pthread_mutex_lock(&m_xpos);
-			xpos--;
-			pthread_mutex_unlock(&m_xpos);
-		}
-		else if (c == 'k') {
-			pthread_mutex_lock(&m_xpos);
-			xpos++;
-			pthread_mutex_unlock(&m_xpos);
+		phase = trace_begin();
+		if ((c == 'j') || (c == 'k')) {
+			clock_gettime(CLOCK_MONOTONIC, &event.stamp);
+			event.dx = (c == 'j') ? -1 : 1;
+			event.seq = ++keys_read;
+			/* a full ring drops the key, the game loop never waits for us */
+			input_ring_push(&steering, &event);
 		}
 	    /* Picard on holo deck: "Computer, exit!" */
 		else if ((c == 'Q') || (c == EOF)) {
 	    	printf("Oh, and I shall quit, bye!\n");
+			if (replays.record_file != NULL) {
+				fclose(replays.record_file);
+				remove(replays.record_name);
+			}
 			unset_term_attr();
 			exit(0);
 	    }
+		trace_end("key", phase);
 	}
 	return NULL;
 }
 		
 
-int
-game(FILE* map, unsigned int startpos, unsigned int size) {
-    char line[size+1u];
-	int result  = 0;
-	unsigned int xmin = 1;
-	unsigned int xmax = size - 1;
-	unsigned int leftmargin  = xmin;
-	unsigned int rightmargin = xmax;
-	unsigned int nmbr = 1;
-	pthread_t pt_input;
+void
+frame_written(const struct input_event* applied)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (applied != NULL) {
+		hist_record(&latency, hist_elapsed(&applied->stamp, &now));
+	}
+	/* early or late, it is off either way */
+	if ((written.tv_sec != 0) || (written.tv_nsec != 0)) {
+		hist_record(&jitter, llabs(hist_elapsed(&written, &now) - period * 1000LL));
+	}
+	written = now;
+}
+
+void
+stop_input(void)
+{
+	/* it waits for a key in getchar(), which gives in to a cancel */
+	pthread_cancel(input_thread);
+	pthread_join(input_thread, NULL);
+}
+
+void
+keys_report(FILE* stream)
+{
+	struct input_event event;
+	unsigned long left;
+
+	/* the keys still in the ring were never applied */
+	for (left = 0; input_ring_pop(&steering, &event); left++);
 
-	xpos  = startpos;
+	fprintf(stream, "Keys: %lu read, %lu applied, %lu dropped with the ring full, "\
+			"%lu left, %ld lost, %lu out of order\n",
+			keys_read, keys_applied, steering.dropped, left,
+			(long)(keys_read - keys_applied - steering.dropped - left), keys_disorder);
+}
 
-	/* initialize track */
-	sprintf(line, "|%*c", size, '|');
+int
+game(struct track_cursor* cursor, int xpos) {
+	const struct track* track = cursor->track;
+	unsigned int leftmargin;
+	unsigned int rightmargin;
+	struct input_event event;
+	struct input_event oldest;
+	unsigned int row = track->first + cursor->row;
+	/* rows raced so far, what the replays count */
+	unsigned int raced = 0;
+	int before;
+	int crashed;
+	unsigned long long phase;
+
+	trace_thread("game");
 
 	/* starting input thread */
-	if ((pt_input = pthread_create( &pt_input, NULL, &get_user_input, NULL))) {
+	if (pthread_create(&input_thread, NULL, &get_user_input, NULL)) {
 		fprintf(stderr, "Thread creation failed, exiting.\n");
 		exit(1);
 	}
 
-    while(running) {
-		result = fscanf(map, "%u %u", &leftmargin, &rightmargin);
-		if (result == EOF) {
-			running = 0;
-			return 1;
-		}
-		else if (result != 2) {
-			printf("There was an error in the map file. Line: %d\n", nmbr);
-			running = 0;
-			unset_term_attr();
-			exit(1);
-		}
-		nmbr++;
+	/* the rows keep to the period however long a frame takes */
+	pace_start(&pace, period);
 
-		if ((leftmargin < xmin) || (leftmargin > xmax)) {
-			printf("There was an error in the map file. Line: %d\n", nmbr);
-			running = 0;
-			unset_term_attr();
-			exit(1);
-		}
-
-		if ((rightmargin < xmin) || (rightmargin > xmax)) {
-			printf("There was an error in the map file. Line: %d\n", nmbr);
-			running = 0;
-			unset_term_attr();
-			exit(1);
-		}
+	/* the track is already validated */
+	phase = trace_begin();
+    while(running && track_next(cursor, &leftmargin, &rightmargin)) {
+		trace_end("fetch", phase);
 
-        /* Wait TIMEOUT */
-		usleep(TIMEOUT);
+        /* Wait for the deadline of the row */
+		phase = trace_begin();
+		pace_wait(&pace);
+		trace_end("wait", phase);
 		
 		if (running) {
-			line[leftmargin] = '#';
-			line[rightmargin] = '#';
-			
-			pthread_mutex_lock(&m_xpos);
-			line[xpos] = 'V';
+			row++;
 
-			printf("%s\n", line);
+			phase = trace_begin();
+			before = xpos;
+			/* the keys only quit while a replay plays */
+			if (replays.playing) {
+				xpos += replay_next(&replays.playback, raced);
+			}
+			/* every key pressed since the last frame */
+			oldest.dx = 0;
+			while (!replays.playing && input_ring_pop(&steering, &event)) {
+				if (oldest.dx == 0) {
+					oldest = event;
+				}
+				xpos += event.dx;
+				/* the ring hands them on in the order they were read */
+				if (event.seq <= keys_last) {
+					keys_disorder++;
+				}
+				keys_last = event.seq;
+				keys_applied++;
+			}
+			/* off the track anyway, but stay within the line */
+			if (xpos < 0) {
+				xpos = 0;
+			}
+			else if (xpos > (int)track->size) {
+				xpos = track->size;
+			}
+			/* the move the car made, within the width like every move of a replay */
+			if (replays.record_file != NULL) {
+				replay_step(&replays.recording, raced, xpos - before);
+			}
+			trace_end("input", phase);
+			view.ghost = (raced < replays.ghost_rows) ? replays.ghost_xpos[raced] : -1;
+			raced++;
 
-			line[xpos] = ' ';
-			line[leftmargin] = ' ';
-			line[rightmargin] = ' ';
+			phase = trace_begin();
+			render_row(&view, leftmargin, rightmargin, xpos);
+			trace_end("render", phase);
 			
 			/* Stay on the track */
-			if ((xpos <= leftmargin) || (xpos >= rightmargin)) {
-				line[xpos] = 'X';
-				printf("%s\n", line);
+			phase = trace_begin();
+			crashed = sim_crashed(xpos, leftmargin, rightmargin);
+			trace_end("collision", phase);
+			if (crashed) {
+				phase = trace_begin();
+				render_crash(&view, xpos);
+				outbuf_flush(&screen);
+				trace_end("write", phase);
+				frame_written(oldest.dx ? &oldest : NULL);
+				spectate_row(&feed, row, leftmargin, rightmargin, xpos, SIM_CRASH);
+				replay_finish(&replays.recording, raced, SIM_CRASH);
 
-				pthread_mutex_unlock(&m_xpos);
 				running = 0;
 				return 0;
 			}
-			pthread_mutex_unlock(&m_xpos);
+			phase = trace_begin();
+			outbuf_flush(&screen);
+			trace_end("write", phase);
+			frame_written(oldest.dx ? &oldest : NULL);
+			spectate_row(&feed, row, leftmargin, rightmargin, xpos, SIM_RUNNING);
 		}
+		phase = trace_begin();
     }
 
 	running = 0;
+	/* a bad row of a streamed map is no goal */
+	if (track_failed(cursor)) {
+		spectate_row(&feed, row, leftmargin, rightmargin, xpos, SIM_ERROR);
+		return -1;
+	}
+	spectate_row(&feed, row, leftmargin, rightmargin, xpos, SIM_GOAL);
+	replay_finish(&replays.recording, raced, SIM_GOAL);
 	return 1;
 }
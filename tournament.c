@@ -0,0 +1,426 @@
+/**
+ * tournament
+ *
+ * Races every bot on every map, without a terminal and without waiting
+ * for frames, on all processors, and writes the results as CSV or JSON.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "track.h"
+#include "sim.h"
+#include "bots.h"
+#include "pool.h"
+
+/* output formats */
+#define FORMAT_CSV  0
+#define FORMAT_JSON 1
+
+/**
+ * The result of one bot on one map.
+ */
+struct result {
+	/* SIM_GOAL, SIM_CRASH or SIM_RUNNING if the row limit was reached */
+	int state;
+	/* rows passed without leaving the road */
+	unsigned int survived;
+	/* the row left the road in, 0 if it did not */
+	unsigned int crash;
+};
+
+/**
+ * Everything the workers need, they only write their own result.
+ */
+struct tournament {
+	const char** names;
+	struct track* tracks;
+	unsigned int maps;
+	const struct bot** bots;
+	unsigned int players;
+	unsigned long seed;
+	unsigned int limit;
+	/* maps * players, map after map */
+	struct result* results;
+};
+
+/**
+ * The standing of a bot over all maps.
+ */
+struct standing {
+	const struct bot* bot;
+	unsigned int goals;
+	unsigned long survived;
+};
+
+/**
+ * Prints how to call the tournament.
+ */
+void
+usage(const char* name);
+
+/**
+ * Runs one pairing, a task of the pool.
+ */
+void
+race(void* context, size_t task);
+
+/**
+ * Picks the bots from a comma separated list of names.
+ *
+ * @return the number of bots, the program exits on unknown names.
+ */
+unsigned int
+pick_bots(char* list, const struct bot** picked);
+
+/**
+ * Writes a string as a JSON or CSV value.
+ */
+void
+put_string(FILE* out, const char* string, int format);
+
+/**
+ * Writes all results.
+ */
+void
+write_results(FILE* out, const struct tournament* tournament, int format);
+
+/**
+ * Sorting the standings with qsort, most goals and rows first.
+ */
+int
+compare_standing(const void* a, const void* b);
+
+int main(int argc, char** argv)
+{
+	struct tournament tournament;
+	struct standing* standings;
+	struct pool_stats stats;
+	struct timespec start;
+	struct timespec end;
+	const struct bot* picked[64];
+	const struct result* result;
+	FILE* map;
+	FILE* out = stdout;
+	const char* output = NULL;
+	char* list = NULL;
+	unsigned int threads = 0;
+	unsigned int errors;
+	unsigned int failed = 0;
+	unsigned int i;
+	unsigned int j;
+	double seconds;
+	unsigned long rows = 0;
+	int format = FORMAT_CSV;
+	int c;
+
+	memset(&tournament, 0, sizeof(tournament));
+	tournament.seed = 1;
+
+	while ((c = getopt(argc, argv, "j:f:b:s:m:o:")) != -1) {
+		switch (c) {
+			case 'j':
+				threads = strtoul(optarg, NULL, 10);
+				break;
+			case 'f':
+				if (!strcmp(optarg, "csv")) {
+					format = FORMAT_CSV;
+				}
+				else if (!strcmp(optarg, "json")) {
+					format = FORMAT_JSON;
+				}
+				else {
+					usage(argv[0]);
+					exit(2);
+				}
+				break;
+			case 'b':
+				list = optarg;
+				break;
+			case 's':
+				tournament.seed = strtoul(optarg, NULL, 10);
+				break;
+			case 'm':
+				tournament.limit = strtoul(optarg, NULL, 10);
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				exit(2);
+		}
+	}
+
+	if (argc == optind) {
+		usage(argv[0]);
+		exit(2);
+	}
+
+	/* without a list every bot races */
+	if (list != NULL) {
+		tournament.players = pick_bots(list, picked);
+	}
+	else {
+		for (i = 0; (i < bot_count) && (i < sizeof(picked) / sizeof(picked[0])); i++) {
+			picked[i] = &bots[i];
+		}
+		tournament.players = i;
+	}
+	tournament.bots = picked;
+
+	/* the maps are loaded once, the bots share them */
+	tournament.names = malloc(sizeof(*tournament.names) * (argc - optind));
+	tournament.tracks = malloc(sizeof(*tournament.tracks) * (argc - optind));
+	if ((tournament.names == NULL) || (tournament.tracks == NULL)) {
+		printf("Not enough memory for the maps.\n");
+		exit(4);
+	}
+	for (i = optind; i < argc; i++) {
+		map = fopen(argv[i], "r");
+		if (map == NULL) {
+			fprintf(stderr, "Could not open map file %s, skipped.\n", argv[i]);
+			failed++;
+			continue;
+		}
+		errors = track_load(map, &tournament.tracks[tournament.maps]);
+		fclose(map);
+		if (errors) {
+			fprintf(stderr, "Found %u error(s) in the map file %s, skipped.\n", errors, argv[i]);
+			track_free(&tournament.tracks[tournament.maps]);
+			failed++;
+			continue;
+		}
+		tournament.names[tournament.maps++] = argv[i];
+	}
+
+	tournament.results = calloc((size_t)tournament.maps * tournament.players + 1, sizeof(struct result));
+	standings = calloc(tournament.players + 1, sizeof(*standings));
+	if ((tournament.results == NULL) || (standings == NULL)) {
+		printf("Not enough memory for the results.\n");
+		exit(4);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (pool_run(threads, (size_t)tournament.maps * tournament.players, race, &tournament, &stats) < 0) {
+		printf("Not enough memory for the workers.\n");
+		exit(4);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if ((output != NULL) && ((out = fopen(output, "w")) == NULL)) {
+		printf("Could not open output file %s.\n", output);
+		exit(3);
+	}
+	write_results(out, &tournament, format);
+	if ((out != stdout) && (fclose(out) != 0)) {
+		printf("There was an error writing the results to %s.\n", output);
+		exit(7);
+	}
+
+	/* the leaderboard, apart from the results so they stay machine readable */
+	for (j = 0; j < tournament.players; j++) {
+		standings[j].bot = tournament.bots[j];
+		for (i = 0; i < tournament.maps; i++) {
+			result = &tournament.results[(size_t)i * tournament.players + j];
+			standings[j].goals += (result->state == SIM_GOAL);
+			standings[j].survived += result->survived;
+			rows += result->survived + (result->crash != 0);
+		}
+	}
+	qsort(standings, tournament.players, sizeof(*standings), compare_standing);
+
+	fprintf(stderr, "\n%-4s %-12s %8s %14s\n", "rank", "bot", "goals", "rows survived");
+	for (j = 0; j < tournament.players; j++) {
+		fprintf(stderr, "%-4u %-12s %4u/%-3u %14lu\n", j + 1, standings[j].bot->name,
+				standings[j].goals, tournament.maps, standings[j].survived);
+	}
+
+	seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "\n%u races, %lu rows in %.3f s on %u thread(s), %lu steal(s).\n",
+			tournament.maps * tournament.players, rows, seconds, stats.threads, stats.steals);
+
+	for (i = 0; i < tournament.maps; i++) {
+		track_free(&tournament.tracks[i]);
+	}
+	free(tournament.tracks);
+	free(tournament.names);
+	free(tournament.results);
+	free(standings);
+	return failed ? 1 : 0;
+}
+
+void
+race(void* context, size_t task)
+{
+	struct tournament* tournament = context;
+	struct result* result = &tournament->results[task];
+	unsigned int map = task / tournament->players;
+	unsigned int player = task % tournament->players;
+	struct sim sim;
+
+	/* the same race whichever worker runs it */
+	bot_race(tournament->bots[player], &tournament->tracks[map],
+			tournament->seed ^ (task * 0x9e3779b97f4a7c15ul),
+			tournament->limit, &sim);
+
+	result->state = sim.state;
+	if (sim.state == SIM_CRASH) {
+		result->crash = sim.row;
+		result->survived = sim.row - 1;
+	}
+	else {
+		result->survived = sim.row;
+	}
+}
+
+unsigned int
+pick_bots(char* list, const struct bot** picked)
+{
+	unsigned int count = 0;
+	char* name;
+
+	for (name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+		if (count == 64) {
+			printf("Too many bots, at most 64.\n");
+			exit(2);
+		}
+		picked[count] = bot_find(name);
+		if (picked[count] == NULL) {
+			printf("There is no bot %s.\n", name);
+			exit(2);
+		}
+		count++;
+	}
+
+	return count;
+}
+
+void
+put_string(FILE* out, const char* string, int format)
+{
+	const char* c;
+
+	putc('"', out);
+	for (c = string; *c; c++) {
+		if (*c == '"') {
+			/* CSV doubles quotes, JSON escapes them */
+			fputs((format == FORMAT_CSV) ? "\"\"" : "\\\"", out);
+		}
+		else if ((format == FORMAT_JSON) && (*c == '\\')) {
+			fputs("\\\\", out);
+		}
+		else if ((format == FORMAT_JSON) && ((unsigned char)*c < 0x20)) {
+			fprintf(out, "\\u%04x", *c);
+		}
+		else {
+			putc(*c, out);
+		}
+	}
+	putc('"', out);
+}
+
+void
+write_results(FILE* out, const struct tournament* tournament, int format)
+{
+	const struct result* result;
+	const char* finish;
+	unsigned int i;
+	unsigned int j;
+
+	if (format == FORMAT_CSV) {
+		fputs("map,bot,rows,crash_row,finish\n", out);
+	}
+	else {
+		fputs("[\n", out);
+	}
+
+	for (i = 0; i < tournament->maps; i++) {
+		for (j = 0; j < tournament->players; j++) {
+			result = &tournament->results[(size_t)i * tournament->players + j];
+			finish = (result->state == SIM_GOAL) ? "goal" : (result->state == SIM_CRASH) ? "crash" : "limit";
+
+			if (format == FORMAT_CSV) {
+				put_string(out, tournament->names[i], format);
+				fprintf(out, ",%s,%u,", tournament->bots[j]->name, result->survived);
+				if (result->crash) {
+					fprintf(out, "%u", result->crash);
+				}
+				fprintf(out, ",%s\n", finish);
+			}
+			else {
+				fputs("  {\"map\": ", out);
+				put_string(out, tournament->names[i], format);
+				fprintf(out, ", \"bot\": \"%s\", \"rows\": %u, \"crash_row\": ",
+						tournament->bots[j]->name, result->survived);
+				if (result->crash) {
+					fprintf(out, "%u", result->crash);
+				}
+				else {
+					fputs("null", out);
+				}
+				fprintf(out, ", \"finish\": \"%s\"}%s\n", finish,
+						((i + 1 == tournament->maps) && (j + 1 == tournament->players)) ? "" : ",");
+			}
+		}
+	}
+
+	if (format == FORMAT_JSON) {
+		fputs("]\n", out);
+	}
+}
+
+int
+compare_standing(const void* a, const void* b)
+{
+	const struct standing* x = a;
+	const struct standing* y = b;
+
+	if (x->goals != y->goals) {
+		return (x->goals < y->goals) ? 1 : -1;
+	}
+	return (x->survived < y->survived) - (x->survived > y->survived);
+}
+
+void
+usage(const char* name)
+{
+	unsigned int i;
+
+	printf("Usage: %s [-j threads] [-f csv|json] [-b bot,...] [-s seed] [-m rows] [-o file] <map> ...\n"\
+		   "       races every bot on every map and writes a line per race:\n"\
+		   "       the rows survived, the row the road was left in and the finish\n"\
+		   "       -j threads to race on (default one per processor)\n"\
+		   "       -f the format of the results (default csv)\n"\
+		   "       -b the bots to race (default all)\n"\
+		   "       -s seed of the bots that guess (default 1)\n"\
+		   "       -m rows to race at most, the finish is \"limit\" then\n"\
+		   "       -o write the results to a file instead of stdout\n", name);
+	printf("       bots:");
+	for (i = 0; i < bot_count; i++) {
+		printf(" %s", bots[i].name);
+	}
+	printf("\n");
+}
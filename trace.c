@@ -0,0 +1,188 @@
+/**
+ * trace
+ *
+ * Records how long the phases of the frames take, every thread into a
+ * buffer of its own, and writes them at exit in the trace event format
+ * of Chrome, for chrome://tracing or Perfetto.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+int trace_enabled = 0;
+
+_Thread_local struct trace_thread* trace_local = NULL;
+
+/* the threads traced and the file, the list is only changed under the lock */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_thread* threads = NULL;
+static unsigned int next_id = 1;
+static FILE* out = NULL;
+static char* name = NULL;
+
+/* when tracing started, the events are relative to it */
+static unsigned long long origin;
+
+/**
+ * A new, empty chunk.
+ */
+static struct trace_chunk*
+chunk_new(void)
+{
+	struct trace_chunk* chunk = malloc(sizeof(*chunk));
+
+	if (chunk != NULL) {
+		atomic_init(&chunk->used, 0);
+		atomic_init(&chunk->next, NULL);
+	}
+	return chunk;
+}
+
+/**
+ * Writes a name as a JSON string, the names are ours and plain.
+ */
+static void
+put_string(const char* string)
+{
+	putc('"', out);
+	for (; *string != '\0'; string++) {
+		if ((*string == '"') || (*string == '\\')) {
+			putc('\\', out);
+		}
+		putc(*string, out);
+	}
+	putc('"', out);
+}
+
+/**
+ * Writes the trace, at exit. The threads may still be running, they only
+ * ever add events after the ones published, so what is read is whole.
+ * The buffers go with the process.
+ */
+static void
+trace_write(void)
+{
+	struct trace_thread* thread;
+	struct trace_chunk* chunk;
+	const struct trace_event* event;
+	unsigned long dropped = 0;
+	unsigned int used;
+	unsigned int i;
+	int first = 1;
+	pid_t pid = getpid();
+
+	trace_enabled = 0;
+
+	pthread_mutex_lock(&lock);
+	fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (thread = threads; thread != NULL; thread = thread->next) {
+		fprintf(out, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":",
+				first ? "" : ",\n", (int)pid, thread->id);
+		put_string(thread->name);
+		fprintf(out, "}}");
+		first = 0;
+
+		for (chunk = thread->first; chunk != NULL;
+				chunk = atomic_load_explicit(&chunk->next, memory_order_acquire)) {
+			used = atomic_load_explicit(&chunk->used, memory_order_acquire);
+			for (i = 0; i < used; i++) {
+				event = &chunk->events[i];
+				fprintf(out, ",\n{\"ph\":\"X\",\"name\":");
+				put_string(event->name);
+				fprintf(out, ",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", (int)pid, thread->id,
+						(event->begin - origin) / 1e3, event->duration / 1e3);
+			}
+		}
+		dropped += thread->dropped;
+	}
+	fprintf(out, "\n]}\n");
+	pthread_mutex_unlock(&lock);
+
+	if (fclose(out) != 0) {
+		printf("There was an error writing the trace to %s.\n", name);
+	}
+	else if (dropped) {
+		printf("The trace in %s lacks %lu event(s), there was not enough memory.\n", name, dropped);
+	}
+	out = NULL;
+}
+
+int
+trace_open(const char* path)
+{
+	out = fopen(path, "w");
+	name = strdup(path);
+	if ((out == NULL) || (name == NULL)) {
+		return -1;
+	}
+
+	trace_enabled = 1;
+	origin = trace_begin();
+	atexit(trace_write);
+	return 0;
+}
+
+void
+trace_thread(const char* thread_name)
+{
+	struct trace_thread* thread;
+
+	if (!trace_enabled || (trace_local != NULL)) {
+		return;
+	}
+
+	thread = calloc(1, sizeof(*thread));
+	if ((thread == NULL) || ((thread->first = chunk_new()) == NULL)) {
+		free(thread);
+		return;
+	}
+	thread->name = thread_name;
+	thread->last = thread->first;
+
+	pthread_mutex_lock(&lock);
+	thread->id = next_id++;
+	thread->next = threads;
+	threads = thread;
+	pthread_mutex_unlock(&lock);
+
+	trace_local = thread;
+}
+
+void
+trace_grow(struct trace_thread* thread, const struct trace_event* event)
+{
+	struct trace_chunk* chunk = chunk_new();
+
+	if (chunk == NULL) {
+		thread->dropped++;
+		return;
+	}
+	chunk->events[0] = *event;
+	atomic_init(&chunk->used, 1);
+	atomic_store_explicit(&thread->last->next, chunk, memory_order_release);
+	thread->last = chunk;
+}
@@ -0,0 +1,142 @@
+/**
+ * trace
+ *
+ * Records how long the phases of the frames take, every thread into a
+ * buffer of its own, and writes them at exit in the trace event format
+ * of Chrome, for chrome://tracing or Perfetto.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdatomic.h>
+#include <time.h>
+
+/* events per chunk of a thread buffer */
+#define TRACE_CHUNK 4096
+
+/**
+ * A phase that took place: its name, a string that lives as long as the
+ * program, when it began and how long it took in nanoseconds.
+ */
+struct trace_event {
+	const char* name;
+	unsigned long long begin;
+	unsigned long long duration;
+};
+
+/**
+ * Events of a thread, a chunk is only added when the last one is full.
+ */
+struct trace_chunk {
+	struct trace_event events[TRACE_CHUNK];
+	/* the events in it, published after they are written */
+	atomic_uint used;
+	_Atomic(struct trace_chunk*) next;
+};
+
+/**
+ * The buffer of a thread, only that thread writes to it.
+ */
+struct trace_thread {
+	const char* name;
+	unsigned int id;
+	struct trace_chunk* first;
+	struct trace_chunk* last;
+	/* events lost without memory for another chunk */
+	unsigned long dropped;
+	struct trace_thread* next;
+};
+
+/* whether anything is traced at all */
+extern int trace_enabled;
+
+/* the buffer of the calling thread, NULL until trace_thread */
+extern _Thread_local struct trace_thread* trace_local;
+
+/**
+ * Starts tracing, the trace is written to a file at exit.
+ *
+ * @return 0 on success, -1 if the file can not be created.
+ */
+int
+trace_open(const char* path);
+
+/**
+ * Gives the calling thread a buffer, under a name for the viewer. Threads
+ * without one are not traced.
+ */
+void
+trace_thread(const char* name);
+
+/**
+ * Adds an event to a full buffer, see trace_end.
+ */
+void
+trace_grow(struct trace_thread* thread, const struct trace_event* event);
+
+/**
+ * The time a phase begins at, 0 if nothing is traced.
+ */
+static inline unsigned long long
+trace_begin(void)
+{
+	struct timespec now;
+
+	if (!trace_enabled) {
+		return 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * Records a phase that began at the time trace_begin returned.
+ *
+ * @param name A string that lives as long as the program.
+ */
+static inline void
+trace_end(const char* name, unsigned long long begin)
+{
+	struct trace_thread* thread = trace_local;
+	struct trace_chunk* chunk;
+	struct trace_event event;
+	unsigned int used;
+
+	if (!trace_enabled || (thread == NULL)) {
+		return;
+	}
+	event.name = name;
+	event.begin = begin;
+	event.duration = trace_begin() - begin;
+
+	chunk = thread->last;
+	used = atomic_load_explicit(&chunk->used, memory_order_relaxed);
+	if (used == TRACE_CHUNK) {
+		trace_grow(thread, &event);
+		return;
+	}
+	chunk->events[used] = event;
+	atomic_store_explicit(&chunk->used, used + 1, memory_order_release);
+}
+
+#endif
@@ -0,0 +1,1288 @@
+/**
+ * track
+ *
+ * Loading and validating of track (map) files.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+
+#include "track.h"
+
+/* rows a streamed track is read ahead, a power of two */
+#define STREAM_ROWS 4096u
+
+/**
+ * A streamed track: a reader thread parses the rows ahead into a ring,
+ * the race only takes them from there.
+ */
+struct track_stream {
+	/* reader thread only */
+	int fd;
+	unsigned int size;
+	char* buffer;
+	/* the unparsed bytes are buffer[start..end) */
+	size_t start;
+	size_t end;
+	/* the line number of the last row, for the messages */
+	unsigned int line;
+	int eof;
+
+	pthread_t thread;
+	int running;
+	/* written to when the reader has to stop */
+	int wake[2];
+
+	/* the ring, guarded by lock */
+	pthread_mutex_t lock;
+	pthread_cond_t filled;
+	pthread_cond_t emptied;
+	unsigned int rows[STREAM_ROWS][2];
+	unsigned int head;
+	unsigned int tail;
+	/* no more rows will come, at the end or at a bad row, error is
+	   set for the latter */
+	int done;
+	int error;
+	int stop;
+
+	/* the race side: rows taken, how often and how long it had to wait */
+	unsigned long taken;
+	unsigned long underruns;
+	double waited;
+	double longest;
+};
+
+/* initial number of rows to allocate, doubled when exceeded */
+#define ROWS_INITIAL 1024u
+
+/* the widest track that fits two bytes per margin */
+#define SIZE_MAX_TRACK 65536u
+
+/* bytes read from a streamed track at once */
+#define STREAM_CHUNK 65536
+
+/* the longest line of a lazy text track */
+#define LINE_MAX_LAZY 256
+
+/* largest n such that 255n(n+1)/2 + (n+1)(65520) < 2^32, see zlib */
+#define ADLER_NMAX 5552
+
+/**
+ * Parses an unsigned number and skips the blanks in front of it.
+ *
+ * @param pos Where to start, set behind the number.
+ * @param value The parsed number.
+ *
+ * @return 1 if a number was found, else 0.
+ */
+static int
+parse_uint(const char** pos, unsigned int* value)
+{
+	const char* p = *pos;
+	unsigned long v = 0;
+
+	while ((*p == ' ') || (*p == '\t')) { p++; }
+	if (!isdigit((unsigned char)*p)) {
+		return 0;
+	}
+	while (isdigit((unsigned char)*p)) {
+		v = v * 10 + (*p - '0');
+		if (v > 0xffffffffUL) {
+			return 0;
+		}
+		p++;
+	}
+
+	*value = (unsigned int)v;
+	*pos = p;
+	return 1;
+}
+
+/**
+ * Checks if only blanks are left in a line.
+ */
+static int
+is_blank(const char* p)
+{
+	while (isspace((unsigned char)*p)) { p++; }
+	return *p == '\0';
+}
+
+static unsigned int
+get_le32(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static void
+put_le32(unsigned char* p, unsigned int v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+/**
+ * Stores a margin in the packed row data.
+ */
+static void
+put_margin(unsigned char* p, unsigned int width, unsigned int v)
+{
+	p[0] = v & 0xff;
+	if (width == 2) {
+		p[1] = (v >> 8) & 0xff;
+	}
+}
+
+/**
+ * Checks the header values every format has in common.
+ *
+ * @return 0 if they are fine, else 1.
+ */
+static unsigned int
+check_header(const struct track* track)
+{
+	if ((track->size < 2) || (track->size > SIZE_MAX_TRACK)) {
+		printf("There was an error in the map file at line 1. "\
+			   "The size %u is not within 2 - %u.\n", track->size, SIZE_MAX_TRACK);
+		return 1;
+	}
+	if ((track->startpos < 1) || (track->startpos >= track->size)) {
+		printf("There was an error in the map file at line 1. "\
+			   "The start position %u does not fit the size %u.\n", track->startpos, track->size);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Reads a margin from packed row data.
+ */
+static unsigned int
+get_margin(const unsigned char* p, unsigned int width)
+{
+	return (width == 1) ? p[0] : (p[0] | (p[1] << 8));
+}
+
+/**
+ * Reports a row with margins out of the track.
+ *
+ * @return 1 if the row is bad, else 0.
+ */
+static unsigned int
+check_row(const struct track* track, unsigned int row, int leftmargin, int rightmargin)
+{
+	if ((leftmargin < 1) || (leftmargin >= (int)track->size)
+			|| (rightmargin < 1) || (rightmargin >= (int)track->size)) {
+		printf("There was an error in the map file. Row: %u (margins %d %d not within %u - %u)\n",
+				row + 1, leftmargin, rightmargin, 1, track->size - 1);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Decodes a whole delta track once, to be sure the racers can
+ * trust it while decoding it on the fly.
+ */
+static unsigned int
+check_delta(const struct track* track)
+{
+	const unsigned char* pos = track->data;
+	const unsigned char* end = track->data + track->length;
+	unsigned int errors = 0;
+	unsigned int row = 0;
+	unsigned int run;
+	unsigned int code;
+	int leftmargin;
+	int rightmargin;
+	int dleft;
+	int dright;
+
+	if (track->rows == 0) {
+		return 0;
+	}
+	if (end - pos < 2 * track->width) {
+		printf("The delta map file is truncated. Row: 1\n");
+		return 1;
+	}
+	leftmargin  = get_margin(pos, track->width);
+	rightmargin = get_margin(pos + track->width, track->width);
+	pos += 2 * track->width;
+	errors += check_row(track, row++, leftmargin, rightmargin);
+
+	while (row < track->rows) {
+		if (pos == end) {
+			printf("The delta map file is truncated. Row: %u\n", row + 1);
+			return errors + 1;
+		}
+		code = *pos >> 4;
+		run  = (*pos & 0x0f) + 1;
+		pos++;
+
+		if (code == TRACK_DELTA_LITERAL) {
+			if (end - pos < 2 * track->width) {
+				printf("The delta map file is truncated. Row: %u\n", row + 1);
+				return errors + 1;
+			}
+			leftmargin  = get_margin(pos, track->width);
+			rightmargin = get_margin(pos + track->width, track->width);
+			pos += 2 * track->width;
+			dleft  = 0;
+			dright = 0;
+			errors += check_row(track, row++, leftmargin, rightmargin);
+			run--;
+		}
+		else if (code < 9) {
+			dleft  = (int)(code / 3) - 1;
+			dright = (int)(code % 3) - 1;
+		}
+		else {
+			printf("There was an error in the delta map file, unknown code %u. Row: %u\n", code, row + 1);
+			return errors + 1;
+		}
+
+		if (run > track->rows - row) {
+			printf("There was an error in the delta map file, it has more rows than %u.\n", track->rows);
+			return errors + 1;
+		}
+		while (run--) {
+			leftmargin  += dleft;
+			rightmargin += dright;
+			errors += check_row(track, row++, leftmargin, rightmargin);
+		}
+	}
+
+	if (pos != end) {
+		printf("There was an error in the delta map file, it has data behind the last row.\n");
+		errors++;
+	}
+
+	return errors;
+}
+
+/**
+ * Reads a binary or delta map by mapping it into memory.
+ *
+ * @param lazy Only check the header, the rows are checked by track_next.
+ */
+static unsigned int
+load_binary(FILE* map, struct track* track, int lazy)
+{
+	unsigned char header[TRACK_HEADER_SIZE];
+	struct stat st;
+	unsigned int errors = 0;
+	unsigned int checksum;
+	unsigned int row;
+
+	if (fread(header, 1, TRACK_HEADER_SIZE, map) != TRACK_HEADER_SIZE) {
+		printf("There was an error in the map file, it is neither a text nor a binary map.\n");
+		return 1;
+	}
+	if (!memcmp(header, TRACK_MAGIC, 4)) {
+		track->format = TRACK_BINARY;
+	}
+	else if (!memcmp(header, TRACK_DELTA_MAGIC, 4)) {
+		track->format = TRACK_DELTA;
+	}
+	else {
+		printf("There was an error in the map file, it is neither a text nor a binary map.\n");
+		return 1;
+	}
+	if ((header[4] != TRACK_VERSION) || ((header[5] != 1) && (header[5] != 2))) {
+		printf("The binary map file has the unknown version %u (width %u).\n", header[4], header[5]);
+		return 1;
+	}
+
+	track->width    = header[5];
+	track->size     = get_le32(header + 8);
+	track->startpos = get_le32(header + 12);
+	track->rows     = get_le32(header + 16);
+	checksum        = get_le32(header + 20);
+
+	if (check_header(track)) {
+		return 1;
+	}
+	if ((track->width == 1) && (track->size > 256)) {
+		printf("The binary map file is %u wide, it does not fit one byte per margin.\n", track->size);
+		return 1;
+	}
+
+	if ((fstat(fileno(map), &st) < 0) || (st.st_size < TRACK_HEADER_SIZE)) {
+		printf("Could not get the size of the binary map file.\n");
+		return 1;
+	}
+	track->length = st.st_size - TRACK_HEADER_SIZE;
+	if ((track->format == TRACK_BINARY) && (track->length != 2 * (size_t)track->width * track->rows)) {
+		printf("The binary map file is truncated, it should hold %u rows.\n", track->rows);
+		return 1;
+	}
+
+	track->mapped = TRACK_HEADER_SIZE + track->length;
+	track->buffer = mmap(NULL, track->mapped, PROT_READ, MAP_PRIVATE, fileno(map), 0);
+	if (track->buffer == MAP_FAILED) {
+		perror("mmap");
+		track->buffer = NULL;
+		track->mapped = 0;
+		return 1;
+	}
+	madvise(track->buffer, track->mapped, MADV_SEQUENTIAL);
+	track->data = (const unsigned char*)track->buffer + TRACK_HEADER_SIZE;
+
+	/* a start in the middle does not wait for all of the map */
+	track->lazy = lazy;
+	if (lazy) {
+		return 0;
+	}
+
+	if (track_checksum(track->data, track->length) != checksum) {
+		printf("The checksum of the binary map file does not match.\n");
+		return 1;
+	}
+
+	if (track->format == TRACK_DELTA) {
+		return check_delta(track);
+	}
+
+	for (row = 0; row < track->rows; row++) {
+		errors += check_row(track, row, track_left(track, row), track_right(track, row));
+	}
+
+	return errors;
+}
+
+/**
+ * Reads the (size)(startpos) line of a text map.
+ *
+ * @return 0 if it is fine, else 1.
+ */
+static unsigned int
+load_header(FILE* map, struct track* track, char** line, size_t* linesize)
+{
+	if ((getline(line, linesize, map) < 0)
+			|| (sscanf(*line, "(%u)(%u)", &track->size, &track->startpos) != 2)) {
+		printf("There was an error in the map file at line 1. (size)(startpos)\n");
+		return 1;
+	}
+	return check_header(track);
+}
+
+/**
+ * Reads a text map, line by line.
+ */
+static unsigned int
+load_text(FILE* map, struct track* track)
+{
+	char* line = NULL;
+	size_t linesize = 0;
+	const char* pos;
+	unsigned int errors = 0;
+	unsigned int nmbr = 1;
+	unsigned int capacity = ROWS_INITIAL;
+	unsigned int leftmargin;
+	unsigned int rightmargin;
+	unsigned int xmin = 1;
+	unsigned int xmax;
+	unsigned char* data;
+	unsigned char* p;
+
+	track->format = TRACK_TEXT;
+
+	if (load_header(map, track, &line, &linesize)) {
+		free(line);
+		return 1;
+	}
+	xmax = track->size - 1;
+	track->width = (track->size > 256) ? 2 : 1;
+
+	track->buffer = malloc(2 * track->width * capacity);
+	if (track->buffer == NULL) {
+		printf("Not enough memory to load the map file.\n");
+		free(line);
+		return 1;
+	}
+
+	while (getline(&line, &linesize, map) >= 0) {
+		nmbr++;
+		pos = line;
+
+		/* empty lines are allowed */
+		if (is_blank(pos)) {
+			continue;
+		}
+
+		if (!parse_uint(&pos, &leftmargin) || !parse_uint(&pos, &rightmargin) || !is_blank(pos)) {
+			printf("There was an error in the map file. Line: %u (left right)\n", nmbr);
+			errors++;
+			continue;
+		}
+
+		if ((leftmargin < xmin) || (leftmargin > xmax)
+				|| (rightmargin < xmin) || (rightmargin > xmax)) {
+			printf("There was an error in the map file. Line: %u (margins %u %u not within %u - %u)\n",
+					nmbr, leftmargin, rightmargin, xmin, xmax);
+			errors++;
+			continue;
+		}
+
+		if (track->rows == capacity) {
+			capacity *= 2;
+			data = realloc(track->buffer, 2 * track->width * (size_t)capacity);
+			if (data == NULL) {
+				printf("Not enough memory to load the map file. Line: %u\n", nmbr);
+				free(line);
+				return errors + 1;
+			}
+			track->buffer = data;
+		}
+
+		p = (unsigned char*)track->buffer + 2 * track->width * (size_t)track->rows;
+		put_margin(p, track->width, leftmargin);
+		put_margin(p + track->width, track->width, rightmargin);
+		track->rows++;
+	}
+	track->data = track->buffer;
+	track->length = 2 * track->width * (size_t)track->rows;
+
+	if (ferror(map)) {
+		printf("Could not read the map file. Line: %u\n", nmbr);
+		errors++;
+	}
+
+	free(line);
+	return errors;
+}
+
+/**
+ * Maps the text of a map from a checkpoint on, track_next parses and
+ * checks the rows as they come. The rows before it are not even read.
+ */
+static unsigned int
+map_text(FILE* map, struct track* track, const struct track_checkpoint* checkpoint, unsigned int rows)
+{
+	char* line = NULL;
+	size_t linesize = 0;
+	struct stat st;
+	unsigned int errors;
+
+	track->format = TRACK_TEXT;
+	errors = load_header(map, track, &line, &linesize);
+	free(line);
+	if (errors) {
+		return 1;
+	}
+
+	if ((fstat(fileno(map), &st) < 0) || ((unsigned long long)st.st_size < checkpoint->offset)
+			|| (checkpoint->row > rows)) {
+		printf("The map file does not fit its index, it has no row %u.\n", checkpoint->row + 1);
+		return 1;
+	}
+	track->first = checkpoint->row;
+	track->rows = rows - checkpoint->row;
+	track->width = (track->size > 256) ? 2 : 1;
+	track->lazy = 1;
+
+	/* an empty file can not be mapped, there is nothing behind the header then */
+	if (st.st_size == 0) {
+		return 0;
+	}
+	track->mapped = st.st_size;
+	track->buffer = mmap(NULL, track->mapped, PROT_READ, MAP_PRIVATE, fileno(map), 0);
+	if (track->buffer == MAP_FAILED) {
+		perror("mmap");
+		track->buffer = NULL;
+		track->mapped = 0;
+		return 1;
+	}
+	madvise(track->buffer, track->mapped, MADV_SEQUENTIAL);
+	track->data = (const unsigned char*)track->buffer + checkpoint->offset;
+	track->length = st.st_size - checkpoint->offset;
+	return 0;
+}
+
+unsigned int
+track_load(FILE* map, struct track* track)
+{
+	return track_load_at(map, track, NULL, 0);
+}
+
+unsigned int
+track_load_at(FILE* map, struct track* track, const struct track_checkpoint* checkpoint,
+		unsigned int rows)
+{
+	int c;
+
+	memset(track, 0, sizeof(*track));
+
+	/* text maps start with their (size)(startpos) header */
+	c = getc(map);
+	if (c == EOF) {
+		printf("There was an error in the map file at line 1. (size)(startpos)\n");
+		return 1;
+	}
+	ungetc(c, map);
+
+	if (c == TRACK_MAGIC[0]) {
+		return load_binary(map, track, checkpoint != NULL);
+	}
+	if (checkpoint != NULL) {
+		return map_text(map, track, checkpoint, rows);
+	}
+	return load_text(map, track);
+}
+
+/**
+ * Reads and checks the next row of a streamed track, in the reader thread.
+ *
+ * @return 1 if there was another row, 0 at the end or when the reader
+ *         has to stop, -1 at a bad row or a read error, which is reported.
+ */
+static int
+stream_parse(struct track_stream* stream, unsigned int* left, unsigned int* right)
+{
+	struct pollfd fds[2];
+	char* newline;
+	const char* pos;
+	ssize_t got;
+
+	while (1) {
+		newline = memchr(stream->buffer + stream->start, '\n', stream->end - stream->start);
+
+		if ((newline == NULL) && !stream->eof) {
+			/* the partial line to the front, more behind it */
+			memmove(stream->buffer, stream->buffer + stream->start, stream->end - stream->start);
+			stream->end -= stream->start;
+			stream->start = 0;
+			if (stream->end == STREAM_CHUNK) {
+				printf("There was an error in the map file. Line: %u (too long)\n", stream->line + 1);
+				return -1;
+			}
+			/* a pipe without a writer may block for good, track_free wakes it up */
+			fds[0].fd = stream->fd;
+			fds[0].events = POLLIN;
+			fds[1].fd = stream->wake[0];
+			fds[1].events = POLLIN;
+			if (poll(fds, 2, -1) < 0) {
+				/* revents are not set, a signal only means to ask again */
+				if (errno == EINTR) {
+					continue;
+				}
+				printf("Could not read the map file. Line: %u\n", stream->line + 1);
+				return -1;
+			}
+			if (fds[1].revents) {
+				return 0;
+			}
+			if (!fds[0].revents) {
+				continue;
+			}
+			got = read(stream->fd, stream->buffer + stream->end, STREAM_CHUNK - stream->end);
+			if ((got < 0) && (errno == EINTR)) {
+				continue;
+			}
+			if (got < 0) {
+				printf("Could not read the map file. Line: %u\n", stream->line + 1);
+				return -1;
+			}
+			stream->eof = (got == 0);
+			stream->end += got;
+			continue;
+		}
+
+		if (newline == NULL) {
+			/* the last line may lack its line break */
+			if (stream->start == stream->end) {
+				return 0;
+			}
+			newline = stream->buffer + stream->end;
+			if (stream->end == STREAM_CHUNK) {
+				printf("There was an error in the map file. Line: %u (too long)\n", stream->line + 1);
+				return -1;
+			}
+			stream->end++;
+		}
+
+		*newline = '\0';
+		pos = stream->buffer + stream->start;
+		stream->start = newline + 1 - stream->buffer;
+		stream->line++;
+
+		/* empty lines are allowed */
+		if (is_blank(pos)) {
+			continue;
+		}
+
+		if (!parse_uint(&pos, left) || !parse_uint(&pos, right) || !is_blank(pos)) {
+			printf("There was an error in the map file. Line: %u (left right)\n", stream->line);
+			return -1;
+		}
+		if ((*left < 1) || (*left >= stream->size) || (*right < 1) || (*right >= stream->size)) {
+			printf("There was an error in the map file. Line: %u (margins %u %u not within %u - %u)\n",
+					stream->line, *left, *right, 1, stream->size - 1);
+			return -1;
+		}
+		return 1;
+	}
+}
+
+/**
+ * The reader thread, it parses rows until the ring is full and waits
+ * for the race to take some.
+ */
+static void*
+stream_reader(void* argument)
+{
+	struct track_stream* stream = argument;
+	unsigned int left;
+	unsigned int right;
+	int more;
+
+	do {
+		more = stream_parse(stream, &left, &right);
+
+		pthread_mutex_lock(&stream->lock);
+		while ((more > 0) && !stream->stop && (stream->head - stream->tail == STREAM_ROWS)) {
+			pthread_cond_wait(&stream->emptied, &stream->lock);
+		}
+		if (stream->stop) {
+			more = 0;
+		}
+		if (more > 0) {
+			stream->rows[stream->head & (STREAM_ROWS - 1)][0] = left;
+			stream->rows[stream->head & (STREAM_ROWS - 1)][1] = right;
+			stream->head++;
+		}
+		else {
+			stream->done = 1;
+			stream->error = (more < 0);
+		}
+		pthread_cond_signal(&stream->filled);
+		pthread_mutex_unlock(&stream->lock);
+	} while (more > 0);
+
+	return NULL;
+}
+
+/**
+ * Takes the next row of a streamed track, it only waits if the reader
+ * has fallen behind, which is counted.
+ *
+ * @return 1 if there was another row, 0 at the end.
+ */
+static int
+stream_take(struct track_stream* stream, unsigned int* left, unsigned int* right)
+{
+	struct timespec start;
+	struct timespec end;
+	double waited;
+	int found = 0;
+
+	pthread_mutex_lock(&stream->lock);
+	if ((stream->head == stream->tail) && !stream->done) {
+		stream->underruns++;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		while ((stream->head == stream->tail) && !stream->done) {
+			pthread_cond_wait(&stream->filled, &stream->lock);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		waited = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+		stream->waited += waited;
+		if (waited > stream->longest) {
+			stream->longest = waited;
+		}
+	}
+	if (stream->head != stream->tail) {
+		*left  = stream->rows[stream->tail & (STREAM_ROWS - 1)][0];
+		*right = stream->rows[stream->tail & (STREAM_ROWS - 1)][1];
+		stream->tail++;
+		stream->taken++;
+		found = 1;
+		pthread_cond_signal(&stream->emptied);
+	}
+	pthread_mutex_unlock(&stream->lock);
+
+	return found;
+}
+
+/**
+ * Whether the reader of a streamed track stopped at a bad row, 0 for
+ * other tracks.
+ */
+static int
+stream_failed(struct track_stream* stream)
+{
+	int error;
+
+	if (stream == NULL) {
+		return 0;
+	}
+	pthread_mutex_lock(&stream->lock);
+	error = stream->error;
+	pthread_mutex_unlock(&stream->lock);
+	return error;
+}
+
+unsigned int
+track_open(FILE* map, struct track* track)
+{
+	struct track_stream* stream;
+	struct stat st;
+	char* line = NULL;
+	size_t linesize = 0;
+	int c;
+
+	if ((fstat(fileno(map), &st) < 0) || S_ISREG(st.st_mode)) {
+		return track_load(map, track);
+	}
+
+	memset(track, 0, sizeof(*track));
+
+	/* stdio must not read ahead, the rows are read from the descriptor */
+	setvbuf(map, NULL, _IONBF, 0);
+	c = getc(map);
+	if (c == EOF) {
+		printf("There was an error in the map file at line 1. (size)(startpos)\n");
+		return 1;
+	}
+	ungetc(c, map);
+	if (c == TRACK_MAGIC[0]) {
+		printf("Binary maps can not be streamed, convert it to text with map_convert.\n");
+		return 1;
+	}
+
+	track->format = TRACK_STREAM;
+	if (load_header(map, track, &line, &linesize)) {
+		free(line);
+		return 1;
+	}
+	free(line);
+	track->width = (track->size > 256) ? 2 : 1;
+
+	stream = calloc(1, sizeof(*stream));
+	if ((stream == NULL) || ((stream->buffer = malloc(STREAM_CHUNK)) == NULL)) {
+		printf("Not enough memory to stream the map file.\n");
+		free(stream);
+		return 1;
+	}
+	track->stream = stream;
+	stream->size = track->size;
+	stream->line = 1;
+	stream->wake[0] = -1;
+	stream->wake[1] = -1;
+	pthread_mutex_init(&stream->lock, NULL);
+	pthread_cond_init(&stream->filled, NULL);
+	pthread_cond_init(&stream->emptied, NULL);
+
+	/* the caller closes the map after opening */
+	stream->fd = dup(fileno(map));
+	if ((stream->fd < 0) || (pipe(stream->wake) < 0)) {
+		perror("dup/pipe");
+		return 1;
+	}
+
+	if (pthread_create(&stream->thread, NULL, stream_reader, stream) != 0) {
+		printf("Could not start reading the map file.\n");
+		return 1;
+	}
+	stream->running = 1;
+	return 0;
+}
+
+void
+track_free(struct track* track)
+{
+	struct track_stream* stream = track->stream;
+
+	if (stream != NULL) {
+		if (stream->running) {
+			pthread_mutex_lock(&stream->lock);
+			stream->stop = 1;
+			pthread_cond_signal(&stream->emptied);
+			pthread_mutex_unlock(&stream->lock);
+			if (write(stream->wake[1], "", 1) < 0) {
+				perror("write");
+			}
+			pthread_join(stream->thread, NULL);
+		}
+		if (stream->fd >= 0) {
+			close(stream->fd);
+		}
+		if (stream->wake[0] >= 0) {
+			close(stream->wake[0]);
+			close(stream->wake[1]);
+		}
+		pthread_mutex_destroy(&stream->lock);
+		pthread_cond_destroy(&stream->filled);
+		pthread_cond_destroy(&stream->emptied);
+		free(stream->buffer);
+		free(stream);
+		track->stream = NULL;
+	}
+	if (track->mapped) {
+		munmap(track->buffer, track->mapped);
+	}
+	else {
+		free(track->buffer);
+	}
+	track->buffer = NULL;
+	track->data = NULL;
+	track->mapped = 0;
+	track->rows = 0;
+}
+
+int
+track_save_text(FILE* out, const struct track* track)
+{
+	struct track_cursor cursor;
+	unsigned int leftmargin;
+	unsigned int rightmargin;
+
+	if (fprintf(out, "(%u)(%u)\n", track->size, track->startpos) < 6) {
+		return -1;
+	}
+
+	track_cursor_init(&cursor, track);
+	while (track_next(&cursor, &leftmargin, &rightmargin)) {
+		if (fprintf(out, "%u %u\n", leftmargin, rightmargin) < 4) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Writes the header of the binary and the delta format.
+ */
+static int
+save_header(FILE* out, const char* magic, unsigned int width,
+		const struct track* track, const unsigned char* data, size_t length)
+{
+	unsigned char header[TRACK_HEADER_SIZE];
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, magic, 4);
+	header[4] = TRACK_VERSION;
+	header[5] = width;
+	put_le32(header + 8, track->size);
+	put_le32(header + 12, track->startpos);
+	put_le32(header + 16, track->rows);
+	put_le32(header + 20, track_checksum(data, length));
+
+	if (fwrite(header, 1, TRACK_HEADER_SIZE, out) != TRACK_HEADER_SIZE) {
+		return -1;
+	}
+	return 0;
+}
+
+int
+track_save_binary(FILE* out, const struct track* track)
+{
+	struct track_cursor cursor;
+	unsigned int width = (track->size > 256) ? 2 : 1;
+	unsigned int leftmargin;
+	unsigned int rightmargin;
+	size_t length = 2 * (size_t)width * track->rows;
+	const unsigned char* data = track->data;
+	unsigned char* packed = NULL;
+	unsigned char* p;
+	int result = 0;
+
+	/* the packed rows can be written as they are if the width matches */
+	if ((track->format == TRACK_DELTA) || (width != track->width)) {
+		packed = malloc(length ? length : 1);
+		if (packed == NULL) {
+			return -1;
+		}
+		p = packed;
+		track_cursor_init(&cursor, track);
+		while (track_next(&cursor, &leftmargin, &rightmargin)) {
+			put_margin(p, width, leftmargin);
+			put_margin(p + width, width, rightmargin);
+			p += 2 * width;
+		}
+		data = packed;
+	}
+
+	if ((save_header(out, TRACK_MAGIC, width, track, data, length) < 0)
+			|| (fwrite(data, 1, length, out) != length)) {
+		result = -1;
+	}
+
+	free(packed);
+	return result;
+}
+
+/**
+ * Appends bytes to a growing buffer.
+ *
+ * @return 0 on success, -1 without memory.
+ */
+static int
+append(unsigned char** buffer, size_t* length, size_t* capacity,
+		const unsigned char* bytes, size_t count)
+{
+	unsigned char* grown;
+
+	if (*length + count > *capacity) {
+		*capacity = (*capacity ? *capacity * 2 : 4096) + count;
+		grown = realloc(*buffer, *capacity);
+		if (grown == NULL) {
+			return -1;
+		}
+		*buffer = grown;
+	}
+	memcpy(*buffer + *length, bytes, count);
+	*length += count;
+	return 0;
+}
+
+int
+track_save_delta(FILE* out, const struct track* track)
+{
+	struct track_cursor cursor;
+	unsigned int width = (track->size > 256) ? 2 : 1;
+	unsigned char* encoded = NULL;
+	size_t length = 0;
+	size_t capacity = 0;
+	unsigned char bytes[5];
+	unsigned int leftmargin;
+	unsigned int rightmargin;
+	unsigned int prevleft = 0;
+	unsigned int prevright = 0;
+	int dleft;
+	int dright;
+	int failed = 0;
+	/* index of the last delta byte, it can be extended until its run is full */
+	size_t last = 0;
+	int have_last = 0;
+	unsigned int code;
+
+	track_cursor_init(&cursor, track);
+	if (track_next(&cursor, &prevleft, &prevright)) {
+		put_margin(bytes, width, prevleft);
+		put_margin(bytes + width, width, prevright);
+		failed |= append(&encoded, &length, &capacity, bytes, 2 * width);
+	}
+
+	while (!failed && track_next(&cursor, &leftmargin, &rightmargin)) {
+		dleft  = (int)leftmargin - (int)prevleft;
+		dright = (int)rightmargin - (int)prevright;
+		prevleft  = leftmargin;
+		prevright = rightmargin;
+
+		if ((dleft < -1) || (dleft > 1) || (dright < -1) || (dright > 1)) {
+			bytes[0] = TRACK_DELTA_LITERAL << 4;
+			put_margin(bytes + 1, width, leftmargin);
+			put_margin(bytes + 1 + width, width, rightmargin);
+			failed |= append(&encoded, &length, &capacity, bytes, 1 + 2 * width);
+			have_last = 0;
+			continue;
+		}
+
+		code = (dleft + 1) * 3 + (dright + 1);
+		if (have_last && ((encoded[last] >> 4) == code) && ((encoded[last] & 0x0f) != 0x0f)) {
+			encoded[last]++;
+			continue;
+		}
+
+		bytes[0] = code << 4;
+		failed |= append(&encoded, &length, &capacity, bytes, 1);
+		last = length - 1;
+		have_last = 1;
+	}
+
+	if (failed || (save_header(out, TRACK_DELTA_MAGIC, width, track, encoded, length) < 0)
+			|| (fwrite(encoded, 1, length, out) != length)) {
+		free(encoded);
+		return -1;
+	}
+
+	free(encoded);
+	return 0;
+}
+
+void
+track_cursor_init(struct track_cursor* cursor, const struct track* track)
+{
+	memset(cursor, 0, sizeof(*cursor));
+	cursor->track = track;
+	cursor->pos = track->data;
+}
+
+void
+track_cursor_seek(struct track_cursor* cursor, const struct track* track,
+		const struct track_checkpoint* checkpoint)
+{
+	track_cursor_init(cursor, track);
+
+	if (track->format == TRACK_DELTA) {
+		cursor->pos = track->data + (checkpoint->offset - TRACK_HEADER_SIZE);
+		cursor->left = checkpoint->left;
+		cursor->right = checkpoint->right;
+		cursor->dleft = checkpoint->dleft;
+		cursor->dright = checkpoint->dright;
+		cursor->run = checkpoint->run;
+	}
+	/* the rows of text tracks are numbered from where they were loaded */
+	cursor->row = checkpoint->row - track->first;
+	cursor->line = checkpoint->line - 1;
+}
+
+/**
+ * Ends a lazy track at a bad row, it was reported.
+ */
+static int
+lazy_failed(struct track_cursor* cursor)
+{
+	cursor->failed = 1;
+	cursor->row = cursor->track->rows;
+	return 0;
+}
+
+/**
+ * Parses the next row of a lazy text track, the same lines load_text
+ * takes as rows.
+ */
+static int
+next_text(struct track_cursor* cursor, unsigned int* left, unsigned int* right)
+{
+	const struct track* track = cursor->track;
+	const char* end = (const char*)track->data + track->length;
+	const char* start;
+	const char* newline;
+	const char* pos;
+	char line[LINE_MAX_LAZY];
+	size_t length;
+
+	while ((start = (const char*)cursor->pos) < end) {
+		newline = memchr(start, '\n', end - start);
+		length = ((newline != NULL) ? newline : end) - start;
+		cursor->pos = (const unsigned char*)((newline != NULL) ? newline + 1 : end);
+		cursor->line++;
+
+		if (length >= sizeof(line)) {
+			printf("There was an error in the map file. Line: %u (too long)\n", cursor->line);
+			return lazy_failed(cursor);
+		}
+		memcpy(line, start, length);
+		line[length] = '\0';
+		pos = line;
+
+		/* empty lines are allowed */
+		if (is_blank(pos)) {
+			continue;
+		}
+
+		if (!parse_uint(&pos, left) || !parse_uint(&pos, right) || !is_blank(pos)) {
+			printf("There was an error in the map file. Line: %u (left right)\n", cursor->line);
+			return lazy_failed(cursor);
+		}
+		if ((*left < 1) || (*left >= track->size) || (*right < 1) || (*right >= track->size)) {
+			printf("There was an error in the map file. Line: %u (margins %u %u not within %u - %u)\n",
+					cursor->line, *left, *right, 1, track->size - 1);
+			return lazy_failed(cursor);
+		}
+		cursor->row++;
+		return 1;
+	}
+
+	printf("The map file ends before row %u, it does not fit its index.\n",
+			track->first + cursor->row + 1);
+	return lazy_failed(cursor);
+}
+
+/**
+ * Checks that the next row of a lazy delta track can be decoded, what
+ * check_delta does for a whole one.
+ *
+ * @return 0 if it can, else 1, which is reported.
+ */
+static unsigned int
+check_delta_next(const struct track_cursor* cursor)
+{
+	const struct track* track = cursor->track;
+	const unsigned char* end = track->data + track->length;
+	unsigned int width = track->width;
+	unsigned int code;
+	unsigned int run;
+
+	if (cursor->row == 0) {
+		run = 1;
+		if (end - cursor->pos < 2 * width) {
+			printf("The delta map file is truncated. Row: 1\n");
+			return 1;
+		}
+	}
+	else if (cursor->run > 0) {
+		return 0;
+	}
+	else if (cursor->pos == end) {
+		printf("The delta map file is truncated. Row: %u\n", cursor->row + 1);
+		return 1;
+	}
+	else {
+		code = *cursor->pos >> 4;
+		run = (*cursor->pos & 0x0f) + 1;
+		if ((code == TRACK_DELTA_LITERAL) && (end - cursor->pos < 1 + 2 * width)) {
+			printf("The delta map file is truncated. Row: %u\n", cursor->row + 1);
+			return 1;
+		}
+		if ((code != TRACK_DELTA_LITERAL) && (code >= 9)) {
+			printf("There was an error in the delta map file, unknown code %u. Row: %u\n",
+					code, cursor->row + 1);
+			return 1;
+		}
+	}
+
+	if (run > track->rows - cursor->row) {
+		printf("There was an error in the delta map file, it has more rows than %u.\n", track->rows);
+		return 1;
+	}
+	return 0;
+}
+
+int
+track_next(struct track_cursor* cursor, unsigned int* left, unsigned int* right)
+{
+	const struct track* track = cursor->track;
+	unsigned int width = track->width;
+	unsigned int code;
+
+	if (track->format == TRACK_STREAM) {
+		if (!stream_take(track->stream, left, right)) {
+			return 0;
+		}
+		cursor->row++;
+		return 1;
+	}
+
+	if (cursor->row >= track->rows) {
+		return 0;
+	}
+
+	/* a track started at a checkpoint was not checked, its rows are now */
+	if (track->lazy && (track->format == TRACK_TEXT)) {
+		return next_text(cursor, left, right);
+	}
+	if (track->lazy && (track->format == TRACK_DELTA) && check_delta_next(cursor)) {
+		return lazy_failed(cursor);
+	}
+
+	if (track->format != TRACK_DELTA) {
+		*left  = track_left(track, cursor->row);
+		*right = track_right(track, cursor->row);
+		if (track->lazy && check_row(track, cursor->row, *left, *right)) {
+			return lazy_failed(cursor);
+		}
+		cursor->row++;
+		return 1;
+	}
+
+	/* delta tracks are checked while loading, no need to do it again */
+	if (cursor->row == 0) {
+		cursor->left  = get_margin(cursor->pos, width);
+		cursor->right = get_margin(cursor->pos + width, width);
+		cursor->pos += 2 * width;
+	}
+	else if ((cursor->run == 0) && ((*cursor->pos >> 4) == TRACK_DELTA_LITERAL)) {
+		/* the literal row itself and a run of copies of it */
+		cursor->run = *cursor->pos & 0x0f;
+		cursor->left  = get_margin(cursor->pos + 1, width);
+		cursor->right = get_margin(cursor->pos + 1 + width, width);
+		cursor->pos += 1 + 2 * width;
+		cursor->dleft  = 0;
+		cursor->dright = 0;
+	}
+	else {
+		if (cursor->run == 0) {
+			code = *cursor->pos >> 4;
+			cursor->run = (*cursor->pos & 0x0f) + 1;
+			cursor->pos++;
+			cursor->dleft  = (int)(code / 3) - 1;
+			cursor->dright = (int)(code % 3) - 1;
+		}
+		cursor->left  += cursor->dleft;
+		cursor->right += cursor->dright;
+		cursor->run--;
+	}
+
+	*left  = cursor->left;
+	*right = cursor->right;
+	if (track->lazy && check_row(track, cursor->row, *left, *right)) {
+		return lazy_failed(cursor);
+	}
+	cursor->row++;
+	return 1;
+}
+
+void
+track_report(const struct track* track, FILE* out)
+{
+	struct track_stream* stream = track->stream;
+
+	if (stream == NULL) {
+		return;
+	}
+	fprintf(out, "Map stream: %lu rows, %lu underrun(s), waited %.1f ms (at most %.1f ms)%s.\n",
+			stream->taken, stream->underruns, stream->waited, stream->longest,
+			stream_failed(stream) ? ", broke off at a bad row" : "");
+}
+
+int
+track_failed(const struct track_cursor* cursor)
+{
+	return cursor->failed || stream_failed(cursor->track->stream);
+}
+
+unsigned int
+track_checksum(const unsigned char* data, size_t length)
+{
+	unsigned long a = 1;
+	unsigned long b = 0;
+	size_t n;
+
+	while (length > 0) {
+		n = (length < ADLER_NMAX) ? length : ADLER_NMAX;
+		length -= n;
+		while (n--) {
+			a += *data++;
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+
+	return (unsigned int)((b << 16) | a);
+}
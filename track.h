@@ -0,0 +1,283 @@
+/**
+ * track
+ *
+ * Loading and validating of track (map) files.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#ifndef TRACK_H
+#define TRACK_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* formats a track can be stored in */
+#define TRACK_TEXT   0
+#define TRACK_BINARY 1
+#define TRACK_DELTA  2
+/* a text map from a pipe, read row by row while racing */
+#define TRACK_STREAM 3
+
+/*
+ * The binary format, all numbers little endian:
+ *
+ *   magic "TRKB", version (1 byte), bytes per margin (1 byte, 1 or 2),
+ *   2 reserved bytes, size, startpos, rows and the adler32 checksum of
+ *   the row data (4 bytes each), followed by left/right pairs of rows.
+ */
+#define TRACK_MAGIC       "TRKB"
+#define TRACK_VERSION     1
+#define TRACK_HEADER_SIZE 24
+
+/*
+ * The delta format has the same header with the magic "TRKD", the
+ * checksum covers the encoded rows. The first row is stored as it is,
+ * every following row as one byte: the high nibble holds the change of
+ * both margins, (left + 1) * 3 + (right + 1), the low nibble how many
+ * rows (minus one) the change is repeated for. The high nibble
+ * TRACK_DELTA_LITERAL is followed by a row stored as it is.
+ */
+#define TRACK_DELTA_MAGIC   "TRKD"
+#define TRACK_DELTA_LITERAL 0xf
+
+/* the reading state of a streamed track, see track.c */
+struct track_stream;
+
+/**
+ * A whole track, loaded and validated before the race starts, or the
+ * header of a streamed one.
+ */
+struct track {
+	/* Trackwidth in characters. */
+	unsigned int size;
+	/* The position where the car/ship/whatever should start. */
+	unsigned int startpos;
+	/* Number of track rows, 0 for a streamed track. */
+	unsigned int rows;
+	/* the row of the map the loaded rows start at, see track_load_at */
+	unsigned int first;
+	/* TRACK_TEXT, TRACK_BINARY, TRACK_DELTA or TRACK_STREAM, the format it was loaded from */
+	unsigned int format;
+	/* started at a checkpoint, track_next checks the rows as they come,
+	   a text track is then kept as the text behind the checkpoint */
+	int lazy;
+	/* bytes per margin, 1 or 2 */
+	unsigned int width;
+	/* left and right margin of every row, one pair after another,
+	   or the encoded rows of a delta track */
+	const unsigned char* data;
+	size_t length;
+
+	/* the memory behind data, either malloc'ed or mmap'ed */
+	void* buffer;
+	size_t mapped;
+
+	/* where the rows of a streamed track come from, else NULL */
+	struct track_stream* stream;
+};
+
+/**
+ * Position in a track, to get one row after another.
+ */
+struct track_cursor {
+	const struct track* track;
+	/* next row to return */
+	unsigned int row;
+	/* next byte of a delta track */
+	const unsigned char* pos;
+	/* the row returned last and the change still to repeat */
+	unsigned int left;
+	unsigned int right;
+	int dleft;
+	int dright;
+	unsigned int run;
+	/* the line of a lazy text track read last, for the messages */
+	unsigned int line;
+	/* the track ended at a bad row, see track_failed */
+	int failed;
+};
+
+/**
+ * Where a row starts in a map file and what a cursor needs to know to
+ * continue there, see track_index.
+ */
+struct track_checkpoint {
+	/* the row, counted from 0 */
+	unsigned int row;
+	/* the line of a text map, for the messages */
+	unsigned int line;
+	/* where the row is in the file */
+	unsigned long long offset;
+	/* the cursor of a delta map, after the row before */
+	unsigned int left;
+	unsigned int right;
+	int dleft;
+	int dright;
+	unsigned int run;
+};
+
+/**
+ * Reads the header and every row of a map file, text, binary or delta.
+ *
+ * Binary and delta maps are mmap'ed, nothing is copied, delta maps are
+ * only decoded once to check them. Every line with an error
+ * is reported, not only the first one.
+ *
+ * @param map The file where the map data is located, may be closed
+ *            after loading.
+ * @param track Filled with the track data, free it with track_free.
+ *
+ * @return the number of errors found, 0 if the track can be used.
+ */
+unsigned int
+track_load(FILE* map, struct track* track);
+
+/**
+ * Like track_load, but from a checkpoint on nothing is read or checked
+ * up front, the start takes as long anywhere in the map: every format
+ * is mapped into memory, a text map from the checkpoint on, and only
+ * the header is checked. track_next checks each row as it comes instead
+ * and ends the track at a bad one, see track_failed. The checksum of a
+ * binary or delta map is not checked then.
+ *
+ * @param checkpoint Where to start, from track_index.
+ * @param rows The rows of the whole map, from track_index.
+ *
+ * @return the number of errors found, 0 if the track can be used.
+ */
+unsigned int
+track_load_at(FILE* map, struct track* track, const struct track_checkpoint* checkpoint,
+		unsigned int rows);
+
+/**
+ * Like track_load, but a text map from a pipe or a FIFO is not read
+ * before the race. A reader thread parses and checks its rows ahead
+ * into a bounded ring while racing, track_next takes them from there.
+ * Such a track may be endless and it can only be raced once, by a
+ * single cursor.
+ *
+ * @param map The file where the map data is located, may be closed
+ *            after opening, it must not have been read from yet.
+ *
+ * @return the number of errors found, 0 if the track can be used.
+ */
+unsigned int
+track_open(FILE* map, struct track* track);
+
+/**
+ * Prints how a streamed track kept up with the race: the rows taken,
+ * how often and how long the race waited for the reader and whether it
+ * broke off at a bad row, nothing for other tracks.
+ */
+void
+track_report(const struct track* track, FILE* out);
+
+/**
+ * Releases the memory of a loaded track.
+ */
+void
+track_free(struct track* track);
+
+/**
+ * Writes a track in the text format, as read by track_load.
+ *
+ * @return 0 on success, else -1.
+ */
+int
+track_save_text(FILE* out, const struct track* track);
+
+/**
+ * Writes a track in the binary format, as read by track_load.
+ *
+ * @return 0 on success, else -1.
+ */
+int
+track_save_binary(FILE* out, const struct track* track);
+
+/**
+ * Writes a track in the delta format, as read by track_load.
+ *
+ * @return 0 on success, else -1.
+ */
+int
+track_save_delta(FILE* out, const struct track* track);
+
+/**
+ * Starts reading a track from its first row.
+ */
+void
+track_cursor_init(struct track_cursor* cursor, const struct track* track);
+
+/**
+ * Continues reading a track at a checkpoint, the next row is the one of
+ * the checkpoint. A text track has to be loaded at or before it.
+ */
+void
+track_cursor_seek(struct track_cursor* cursor, const struct track* track,
+		const struct track_checkpoint* checkpoint);
+
+/**
+ * Gets the next row of a track, delta tracks are decoded on the fly,
+ * streamed tracks only wait if the reader thread fell behind.
+ *
+ * @return 1 if there was another row, 0 at the end of the track, or at
+ *         a bad row of a streamed or lazy track, which is reported, see
+ *         track_failed.
+ */
+int
+track_next(struct track_cursor* cursor, unsigned int* left, unsigned int* right);
+
+/**
+ * Whether a streamed or lazy track ended at a bad row or a read error
+ * instead of its end, once track_next returned 0. That end is no goal.
+ */
+int
+track_failed(const struct track_cursor* cursor);
+
+/**
+ * The adler32 checksum of a block of memory.
+ */
+unsigned int
+track_checksum(const unsigned char* data, size_t length);
+
+/**
+ * The left margin of a row, only for text and binary tracks that are
+ * not lazy text.
+ */
+static inline unsigned int
+track_left(const struct track* track, unsigned int row)
+{
+	const unsigned char* p = track->data + 2 * track->width * (size_t)row;
+	return (track->width == 1) ? p[0] : (p[0] | (p[1] << 8));
+}
+
+/**
+ * The right margin of a row, only for text and binary tracks that are
+ * not lazy text.
+ */
+static inline unsigned int
+track_right(const struct track* track, unsigned int row)
+{
+	const unsigned char* p = track->data + 2 * track->width * (size_t)row + track->width;
+	return (track->width == 1) ? p[0] : (p[0] | (p[1] << 8));
+}
+
+#endif
@@ -0,0 +1,354 @@
+/**
+ * track_gen
+ *
+ * Generates tracks in the text format, with the rules of the editors:
+ * the margins stay within the track, move one column per row at most
+ * and keep a gap of at least 3. The same seed gives the same track.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+/* the narrowest gap the editors allow */
+#define GAP_MIN 3
+
+/* the widest track that fits two bytes per margin, like track.c */
+#define SIZE_MAX_TRACK 65536u
+
+/* bytes collected before they are written */
+#define BUFFLEN (1 << 20)
+
+/* longest row: two numbers, a blank and a line break, with the
+   bytes copied behind the numbers */
+#define ROW_MAX 24
+
+/**
+ * A margin as text, written as a whole and cut to its length.
+ */
+struct number {
+	char text[7];
+	unsigned char length;
+};
+
+/**
+ * How the track is shaped.
+ */
+struct generator {
+	unsigned long long state;
+	unsigned int size;
+	unsigned int gap;
+	unsigned int widest;
+	/* chance per row in 1/1024 that the road turns or changes its width */
+	unsigned int turns;
+	unsigned int widens;
+	unsigned int left;
+	unsigned int right;
+	/* where the road is heading, -1, 0 or 1 for both */
+	int drift;
+	int widen;
+};
+
+/**
+ * Prints how to call the generator.
+ */
+void
+usage(const char* name);
+
+/**
+ * Sets up the first row, in the middle at half the widest width.
+ */
+void
+generator_init(struct generator* gen, unsigned long seed, unsigned int size,
+		unsigned int gap, unsigned int widest, unsigned int difficulty);
+
+/**
+ * Moves on to the next row.
+ */
+void
+generator_step(struct generator* gen);
+
+/**
+ * Writes a number, without printf.
+ *
+ * @return behind the last digit.
+ */
+char*
+put_number(char* p, unsigned int value);
+
+/**
+ * Writes the whole buffer.
+ */
+void
+put_all(const char* data, size_t length);
+
+int main(int argc, char** argv)
+{
+	struct generator gen;
+	unsigned long seed = 1;
+	unsigned long long rows = 1000;
+	unsigned long long row;
+	unsigned int size = 40;
+	unsigned int gap = GAP_MIN;
+	unsigned int widest = 0;
+	unsigned int difficulty = 30;
+	struct number* numbers;
+	char* buffer;
+	char* p;
+	unsigned int i;
+	int c;
+
+	while ((c = getopt(argc, argv, "s:n:w:g:W:d:")) != -1) {
+		switch (c) {
+			case 's':
+				seed = strtoul(optarg, NULL, 10);
+				break;
+			case 'n':
+				rows = strtoull(optarg, NULL, 10);
+				break;
+			case 'w':
+				size = strtoul(optarg, NULL, 10);
+				break;
+			case 'g':
+				gap = strtoul(optarg, NULL, 10);
+				break;
+			case 'W':
+				widest = strtoul(optarg, NULL, 10);
+				break;
+			case 'd':
+				difficulty = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				usage(argv[0]);
+				exit(2);
+		}
+	}
+
+	/* the margins are 1 to size - 1 */
+	if (widest == 0) {
+		widest = size - 2;
+	}
+	if ((argc != optind) || (size < GAP_MIN + 2) || (size > SIZE_MAX_TRACK) || (gap < GAP_MIN)
+			|| (widest < gap) || (widest > size - 2) || (difficulty > 100)) {
+		usage(argv[0]);
+		exit(2);
+	}
+
+	buffer = malloc(BUFFLEN);
+	numbers = malloc(sizeof(*numbers) * size);
+	if ((buffer == NULL) || (numbers == NULL)) {
+		printf("Not enough memory for the output buffer.\n");
+		exit(4);
+	}
+
+	/* every margin there can be, formatted once */
+	for (i = 0; i < size; i++) {
+		numbers[i].length = put_number(numbers[i].text, i) - numbers[i].text;
+	}
+
+	generator_init(&gen, seed, size, gap, widest, difficulty);
+
+	/* a reader that is gone ends the track, see put_all */
+	signal(SIGPIPE, SIG_IGN);
+
+	p = buffer;
+	*p++ = '(';
+	p = put_number(p, size);
+	*p++ = ')';
+	*p++ = '(';
+	p = put_number(p, (gen.left + gen.right) / 2);
+	*p++ = ')';
+	*p++ = '\n';
+
+	/* without a number of rows it goes on until the reader is gone */
+	for (row = 0; (rows == 0) || (row < rows); row++) {
+		if (p - buffer > BUFFLEN - ROW_MAX) {
+			put_all(buffer, p - buffer);
+			p = buffer;
+		}
+		/* the whole struct is copied, the bytes behind the digits are overwritten */
+		memcpy(p, &numbers[gen.left], sizeof(*numbers));
+		p += numbers[gen.left].length;
+		*p++ = ' ';
+		memcpy(p, &numbers[gen.right], sizeof(*numbers));
+		p += numbers[gen.right].length;
+		*p++ = '\n';
+
+		generator_step(&gen);
+	}
+	put_all(buffer, p - buffer);
+
+	free(numbers);
+	free(buffer);
+	return 0;
+}
+
+/**
+ * xorshift64*, fast and good enough for roads.
+ */
+static unsigned int
+next_random(struct generator* gen)
+{
+	gen->state ^= gen->state >> 12;
+	gen->state ^= gen->state << 25;
+	gen->state ^= gen->state >> 27;
+	return (unsigned int)((gen->state * 0x2545f4914f6cdd1dull) >> 32);
+}
+
+void
+generator_init(struct generator* gen, unsigned long seed, unsigned int size,
+		unsigned int gap, unsigned int widest, unsigned int difficulty)
+{
+	unsigned int width;
+
+	memset(gen, 0, sizeof(*gen));
+	/* never 0, xorshift would stay there */
+	gen->state = seed * 0x9e3779b97f4a7c15ull + 1;
+	gen->size = size;
+	gen->gap = gap;
+	gen->widest = widest;
+
+	/* the harder, the more often the road turns and narrows */
+	gen->turns = difficulty * 3;
+	gen->widens = difficulty * 2;
+
+	width = (gap + widest) / 2;
+	gen->left = (size - width) / 2;
+	gen->right = gen->left + width;
+}
+
+void
+generator_step(struct generator* gen)
+{
+	int dleft;
+	int dright;
+
+	/* one number for all decisions of a row, 10 bits each */
+	unsigned int random = next_random(gen);
+
+	if ((random & 0x3ff) < gen->turns) {
+		gen->drift = (int)(((random >> 10) & 0x3ff) % 3) - 1;
+	}
+	if (((random >> 20) & 0x3ff) < gen->widens) {
+		gen->widen = (int)(next_random(gen) % 3) - 1;
+	}
+
+	/* turning moves both margins, widening only one of them */
+	dleft = gen->drift;
+	dright = gen->drift;
+	if ((gen->widen < 0) && (dleft < 1)) {
+		dleft++;
+	}
+	else if ((gen->widen > 0) && (dright < 1)) {
+		dright++;
+	}
+
+	/* bounce off the borders */
+	if ((int)gen->left + dleft < 1) {
+		dleft = 0;
+		gen->drift = 1;
+	}
+	if (gen->right + dright > gen->size - 1) {
+		dright = 0;
+		gen->drift = -1;
+	}
+
+	/* neither too narrow nor too wide, standing still is always allowed */
+	if ((int)(gen->right + dright) - (int)(gen->left + dleft) < (int)gen->gap) {
+		if (dleft > 0) {
+			dleft = 0;
+		}
+		if (dright < 0) {
+			dright = 0;
+		}
+		gen->widen = 1;
+	}
+	if ((int)(gen->right + dright) - (int)(gen->left + dleft) > (int)gen->widest) {
+		if (dleft < 0) {
+			dleft = 0;
+		}
+		if (dright > 0) {
+			dright = 0;
+		}
+		gen->widen = -1;
+	}
+
+	gen->left += dleft;
+	gen->right += dright;
+}
+
+char*
+put_number(char* p, unsigned int value)
+{
+	char digits[10];
+	unsigned int count = 0;
+
+	do {
+		digits[count++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+
+	while (count) {
+		*p++ = digits[--count];
+	}
+	return p;
+}
+
+void
+put_all(const char* data, size_t length)
+{
+	ssize_t written;
+
+	while (length > 0) {
+		written = write(STDOUT_FILENO, data, length);
+		if ((written < 0) && (errno == EINTR)) {
+			continue;
+		}
+		if (written < 0) {
+			/* the reader is gone, the endless track ends here */
+			if (errno != EPIPE) {
+				perror("write");
+			}
+			exit((errno == EPIPE) ? 0 : 1);
+		}
+		data += written;
+		length -= written;
+	}
+}
+
+void
+usage(const char* name)
+{
+	printf("Usage: %s [-s seed] [-n rows] [-w size] [-g gap] [-W widest] [-d difficulty]\n"\
+		   "       writes a track to stdout, the same seed gives the same track\n"\
+		   "       -s seed (default 1)\n"\
+		   "       -n rows, 0 for an endless track (default 1000)\n"\
+		   "       -w trackwidth in characters (default 40)\n"\
+		   "       -g the narrowest gap between the margins, at least 3 (default 3)\n"\
+		   "       -W the widest gap (default size - 2)\n"\
+		   "       -d 0 to 100, how often the road turns and narrows (default 30)\n"\
+		   "       endless tracks go straight into the racer:\n"\
+		   "          term_racer <(track_gen -n 0)\n", name);
+}
@@ -0,0 +1,104 @@
+/**
+ * track_index
+ *
+ * Writes the index of maps, so term_racer and thread_racer can start a
+ * race anywhere with -r without reading the rows before.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "track.h"
+#include "index.h"
+
+/**
+ * Prints how to call the indexer.
+ */
+void
+usage(const char* name);
+
+int main(int argc, char** argv)
+{
+	struct track_index index;
+	unsigned int stride = INDEX_STRIDE;
+	unsigned int errors;
+	unsigned int failed = 0;
+	FILE* map;
+	int i;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+			case 'n':
+				stride = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				usage(argv[0]);
+				exit(2);
+		}
+	}
+
+	if ((argc == optind) || (stride == 0)) {
+		usage(argv[0]);
+		exit(2);
+	}
+
+	for (i = optind; i < argc; i++) {
+		map = fopen(argv[i], "r");
+		if (map == NULL) {
+			printf("Could not open map file %s.\n", argv[i]);
+			failed++;
+			continue;
+		}
+
+		errors = index_build(map, stride, &index);
+		fclose(map);
+		if (errors) {
+			printf("Found %u error(s) in the map file %s, no index written.\n", errors, argv[i]);
+			index_free(&index);
+			failed++;
+			continue;
+		}
+
+		if (index_save(argv[i], &index) < 0) {
+			printf("Could not write the index %s.idx.\n", argv[i]);
+			failed++;
+		}
+		else {
+			printf("%s.idx: %u checkpoint(s), one every %u rows.\n", argv[i], index.count, stride);
+		}
+		index_free(&index);
+	}
+
+	return failed ? 1 : 0;
+}
+
+void
+usage(const char* name)
+{
+	printf("Usage: %s [-n rows] <map> ...\n"\
+		   "       writes the index <map>.idx next to every map, racers use it\n"\
+		   "       to start with -r in the middle of the track; it is only used\n"\
+		   "       as long as the map is not changed\n"\
+		   "       -n rows between the checkpoints (default %u)\n", name, INDEX_STRIDE);
+}
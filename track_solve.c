@@ -0,0 +1,155 @@
+/**
+ * track_solve
+ *
+ * Tells whether tracks can be won at all, moving one column per row,
+ * and writes the steering that wins with the fewest keys for race_sim.
+ *
+ * @if copyright
+ *
+ * term_racer
+ * Copyright (C) 2004 Benjamin Peter
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * @endif
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "track.h"
+#include "sim.h"
+#include "solve.h"
+
+/* keys per line of the steering */
+#define KEYS_PER_LINE 64
+
+/**
+ * Prints how to call the solver.
+ */
+void
+usage(const char* name);
+
+int main(int argc, char** argv)
+{
+	FILE* map;
+	FILE* out = NULL;
+	const char* output = NULL;
+	struct track track;
+	struct solve solve;
+	struct sim sim;
+	struct timespec start;
+	struct timespec end;
+	unsigned long presses;
+	unsigned long long rows = 0;
+	unsigned int lost = 0;
+	unsigned int errors;
+	int dx;
+	int i;
+	int c;
+
+	while ((c = getopt(argc, argv, "o:")) != -1) {
+		switch (c) {
+			case 'o':
+				output = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				exit(2);
+		}
+	}
+
+	/* one steering file is for one map */
+	if ((argc == optind) || ((output != NULL) && (argc - optind != 1))) {
+		usage(argv[0]);
+		exit(2);
+	}
+
+	if ((output != NULL) && ((out = fopen(output, "w")) == NULL)) {
+		printf("Could not open output file %s.\n", output);
+		exit(3);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = optind; i < argc; i++) {
+		map = fopen(argv[i], "r");
+		if (map == NULL) {
+			printf("Could not open map file %s.\n", argv[i]);
+			exit(3);
+		}
+		errors = track_load(map, &track);
+		fclose(map);
+		if (errors) {
+			printf("Found %u error(s) in the map file %s.\n", errors, argv[i]);
+			exit(3);
+		}
+
+		if (solve_init(&solve, &track) < 0) {
+			printf("Not enough memory to solve %s.\n", argv[i]);
+			exit(4);
+		}
+
+		/* the plan is raced as it is made, what it reaches is what counts */
+		presses = 0;
+		sim_init(&sim, &track);
+		while (sim.state == SIM_RUNNING) {
+			dx = solve_next(&solve);
+			presses += (dx != 0);
+			if ((out != NULL) && (sim.row < solve.rows)) {
+				putc((dx < 0) ? 'j' : (dx > 0) ? 'k' : '.', out);
+				if ((sim.row + 1) % KEYS_PER_LINE == 0) {
+					putc('\n', out);
+				}
+			}
+			sim_step(&sim, dx);
+		}
+		rows += sim.row;
+
+		if (sim.state == SIM_GOAL) {
+			printf("%s: can be won, %u rows with %lu key(s) pressed.\n", argv[i], sim.row, presses);
+		}
+		else {
+			printf("%s: can not be won, no position survives row %u.\n", argv[i], solve.dead);
+			lost++;
+		}
+
+		solve_free(&solve);
+		track_free(&track);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (out != NULL) {
+		putc('\n', out);
+		if (fclose(out) != 0) {
+			printf("There was an error writing the steering to %s.\n", output);
+			exit(7);
+		}
+	}
+
+	fprintf(stderr, "%d map(s), %llu rows in %.3f s.\n", argc - optind, rows,
+			(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+	return lost ? 1 : 0;
+}
+
+void
+usage(const char* name)
+{
+	printf("Usage: %s [-o steering] <map> ...\n"\
+		   "       tells for every map whether it can be won, moving one column\n"\
+		   "       per row at most, and how few keys it takes\n"\
+		   "       -o write the steering that wins with the fewest keys, or gets\n"\
+		   "          furthest, for race_sim (one map only):\n"\
+		   "          race_sim <map> <steering>\n", name);
+}